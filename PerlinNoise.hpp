@@ -38,9 +38,89 @@
 # include <numeric>
 # include <random>
 # include <type_traits>
+# include <utility>
+# include <cmath>
+# include <cstddef>
+# if defined(__AVX2__)
+# include <immintrin.h>
+# elif defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+# endif
 
 namespace siv
 {
+	namespace detail
+	{
+		//	Lane types for the batched double-precision kernels. Every operation is a plain
+		//	IEEE mul/add/sub in the same order as the scalar code, so results are bit-identical
+		//	to noise3D() as long as the scalar path isn't contracted into FMA by the compiler
+		//	(e.g. -march=native with -ffp-contract=fast), in which case they differ by < 1e-14.
+	# if defined(__AVX2__)
+		struct PerlinLanes
+		{
+			static constexpr std::size_t size = 4;
+			using F = __m256d;
+			using I = __m128i; // 4 x int32
+
+			static F load(const double* p) noexcept { return _mm256_loadu_pd(p); }
+			static void store(double* p, F v) noexcept { _mm256_storeu_pd(p, v); }
+			static F set1(double v) noexcept { return _mm256_set1_pd(v); }
+			static F add(F a, F b) noexcept { return _mm256_add_pd(a, b); }
+			static F sub(F a, F b) noexcept { return _mm256_sub_pd(a, b); }
+			static F mul(F a, F b) noexcept { return _mm256_mul_pd(a, b); }
+			static F floor(F v) noexcept { return _mm256_floor_pd(v); }
+			static I toInt(F v) noexcept { return _mm256_cvttpd_epi32(v); }
+
+			static I iset1(std::int32_t v) noexcept { return _mm_set1_epi32(v); }
+			static I iadd(I a, I b) noexcept { return _mm_add_epi32(a, b); }
+			static I iand(I a, I b) noexcept { return _mm_and_si128(a, b); }
+			static I gather(const std::int32_t* t, I idx) noexcept { return _mm_i32gather_epi32(t, idx, 4); }
+
+			// lanes where a == b, widened to double masks
+			static F eq(I a, I b) noexcept { return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpeq_epi32(a, b))); }
+			static F lt(I a, I b) noexcept { return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(a, b))); }
+			static F select(F mask, F a, F b) noexcept { return _mm256_blendv_pd(b, a, mask); }
+			static F orMask(F a, F b) noexcept { return _mm256_or_pd(a, b); }
+			static F negateIf(F mask, F v) noexcept { return _mm256_xor_pd(v, _mm256_and_pd(mask, _mm256_set1_pd(-0.0))); }
+		};
+	# elif defined(__SSE2__) || defined(_M_X64)
+		struct PerlinLanes
+		{
+			static constexpr std::size_t size = 2;
+			using F = __m128d;
+			using I = __m128i; // low 2 x int32 used
+
+			static F load(const double* p) noexcept { return _mm_loadu_pd(p); }
+			static void store(double* p, F v) noexcept { _mm_storeu_pd(p, v); }
+			static F set1(double v) noexcept { return _mm_set1_pd(v); }
+			static F add(F a, F b) noexcept { return _mm_add_pd(a, b); }
+			static F sub(F a, F b) noexcept { return _mm_sub_pd(a, b); }
+			static F mul(F a, F b) noexcept { return _mm_mul_pd(a, b); }
+			static F floor(F v) noexcept
+			{
+				// exact for |v| < 2^31, same range the scalar int cast needs
+				const F t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(v));
+				return _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, v), _mm_set1_pd(1.0)));
+			}
+			static I toInt(F v) noexcept { return _mm_cvttpd_epi32(v); }
+
+			static I iset1(std::int32_t v) noexcept { return _mm_set1_epi32(v); }
+			static I iadd(I a, I b) noexcept { return _mm_add_epi32(a, b); }
+			static I iand(I a, I b) noexcept { return _mm_and_si128(a, b); }
+			static I gather(const std::int32_t* t, I idx) noexcept
+			{
+				return _mm_setr_epi32(t[_mm_cvtsi128_si32(idx)], t[_mm_cvtsi128_si32(_mm_srli_si128(idx, 4))], 0, 0);
+			}
+
+			static F eq(I a, I b) noexcept { const I m = _mm_cmpeq_epi32(a, b); return _mm_castsi128_pd(_mm_unpacklo_epi32(m, m)); }
+			static F lt(I a, I b) noexcept { const I m = _mm_cmplt_epi32(a, b); return _mm_castsi128_pd(_mm_unpacklo_epi32(m, m)); }
+			static F select(F mask, F a, F b) noexcept { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+			static F orMask(F a, F b) noexcept { return _mm_or_pd(a, b); }
+			static F negateIf(F mask, F v) noexcept { return _mm_xor_pd(v, _mm_and_pd(mask, _mm_set1_pd(-0.0))); }
+		};
+	# endif
+	}
+
 # ifdef __cpp_lib_concepts
 	template <std::floating_point Float>
 # else
@@ -55,6 +135,7 @@ namespace siv
 	private:
 
 		std::uint8_t p[512];
+		std::int32_t pi[512]; // widened copy of p for gathers
 
 		[[nodiscard]]
 		static constexpr value_type Fade(value_type t) noexcept
@@ -77,6 +158,125 @@ namespace siv
 			return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
 		}
 
+		void widenTable() noexcept
+		{
+			for (std::size_t i = 0; i < 512; ++i)
+			{
+				pi[i] = p[i];
+			}
+		}
+
+	# if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+		using Lanes = detail::PerlinLanes;
+
+		[[nodiscard]]
+		static typename Lanes::F FadeLanes(typename Lanes::F t) noexcept
+		{
+			using L = Lanes;
+			const typename L::F t3 = L::mul(L::mul(t, t), t);
+			return L::mul(t3, L::add(L::mul(t, L::sub(L::mul(t, L::set1(6)), L::set1(15))), L::set1(10)));
+		}
+
+		[[nodiscard]]
+		static typename Lanes::F LerpLanes(typename Lanes::F t, typename Lanes::F a, typename Lanes::F b) noexcept
+		{
+			return Lanes::add(a, Lanes::mul(t, Lanes::sub(b, a)));
+		}
+
+		[[nodiscard]]
+		static typename Lanes::F GradLanes(typename Lanes::I hash, typename Lanes::F x, typename Lanes::F y, typename Lanes::F z) noexcept
+		{
+			using L = Lanes;
+			const typename L::I h = L::iand(hash, L::iset1(15));
+			const typename L::F u = L::select(L::lt(h, L::iset1(8)), x, y);
+			const typename L::F v = L::select(L::lt(h, L::iset1(4)), y,
+				L::select(L::orMask(L::eq(h, L::iset1(12)), L::eq(h, L::iset1(14))), x, z));
+			const typename L::F negU = L::eq(L::iand(h, L::iset1(1)), L::iset1(1));
+			const typename L::F negV = L::eq(L::iand(h, L::iset1(2)), L::iset1(2));
+			return L::add(L::negateIf(negU, u), L::negateIf(negV, v));
+		}
+
+		[[nodiscard]]
+		typename Lanes::F noise3DLanes(typename Lanes::F x, typename Lanes::F y, typename Lanes::F z) const noexcept
+		{
+			using L = Lanes;
+			using I = typename L::I;
+			const typename L::F fx = L::floor(x), fy = L::floor(y), fz = L::floor(z);
+			const I m255 = L::iset1(255), one = L::iset1(1);
+			const I X = L::iand(L::toInt(fx), m255);
+			const I Y = L::iand(L::toInt(fy), m255);
+			const I Z = L::iand(L::toInt(fz), m255);
+
+			x = L::sub(x, fx);
+			y = L::sub(y, fy);
+			z = L::sub(z, fz);
+
+			const typename L::F u = FadeLanes(x);
+			const typename L::F v = FadeLanes(y);
+			const typename L::F w = FadeLanes(z);
+
+			const I A = L::iadd(L::gather(pi, X), Y);
+			const I AA = L::iadd(L::gather(pi, A), Z), AB = L::iadd(L::gather(pi, L::iadd(A, one)), Z);
+			const I B = L::iadd(L::gather(pi, L::iadd(X, one)), Y);
+			const I BA = L::iadd(L::gather(pi, B), Z), BB = L::iadd(L::gather(pi, L::iadd(B, one)), Z);
+
+			const typename L::F c1 = L::set1(1);
+			const typename L::F x1 = L::sub(x, c1), y1 = L::sub(y, c1), z1 = L::sub(z, c1);
+
+			return LerpLanes(w, LerpLanes(v, LerpLanes(u, GradLanes(L::gather(pi, AA), x, y, z),
+				GradLanes(L::gather(pi, BA), x1, y, z)),
+				LerpLanes(u, GradLanes(L::gather(pi, AB), x, y1, z),
+				GradLanes(L::gather(pi, BB), x1, y1, z))),
+				LerpLanes(v, LerpLanes(u, GradLanes(L::gather(pi, L::iadd(AA, one)), x, y, z1),
+				GradLanes(L::gather(pi, L::iadd(BA, one)), x1, y, z1)),
+				LerpLanes(u, GradLanes(L::gather(pi, L::iadd(AB, one)), x, y1, z1),
+				GradLanes(L::gather(pi, L::iadd(BB, one)), x1, y1, z1))));
+		}
+
+		[[nodiscard]]
+		typename Lanes::F noise2DLanes(typename Lanes::F x, typename Lanes::F y) const noexcept
+		{
+			using L = Lanes;
+			using I = typename L::I;
+			const typename L::F fx = L::floor(x), fy = L::floor(y);
+			const I m255 = L::iset1(255), one = L::iset1(1);
+			const I X = L::iand(L::toInt(fx), m255);
+			const I Y = L::iand(L::toInt(fy), m255);
+
+			x = L::sub(x, fx);
+			y = L::sub(y, fy);
+
+			const typename L::F u = FadeLanes(x);
+			const typename L::F v = FadeLanes(y);
+
+			const I A = L::iadd(L::gather(pi, X), Y);
+			const I B = L::iadd(L::gather(pi, L::iadd(X, one)), Y);
+
+			const typename L::F c1 = L::set1(1), zero = L::set1(0);
+			const typename L::F x1 = L::sub(x, c1), y1 = L::sub(y, c1);
+
+			return LerpLanes(v, LerpLanes(u, GradLanes(L::gather(pi, L::gather(pi, A)), x, y, zero),
+				GradLanes(L::gather(pi, L::gather(pi, B)), x1, y, zero)),
+				LerpLanes(u, GradLanes(L::gather(pi, L::gather(pi, L::iadd(A, one))), x, y1, zero),
+				GradLanes(L::gather(pi, L::gather(pi, L::iadd(B, one))), x1, y1, zero)));
+		}
+	# endif
+
+		[[nodiscard]]
+		static constexpr value_type Grad2(std::uint8_t hash, value_type x, value_type y) noexcept
+		{
+			const std::uint8_t h = hash & 15;
+			const value_type u = h < 8 ? x : y;
+			const value_type v = h < 4 ? y : h == 12 || h == 14 ? x : 0;
+			return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+		}
+
+		template <std::int32_t I>
+		static constexpr value_type OctaveScale = static_cast<value_type>(1ull << I);
+
+		template <std::int32_t I>
+		static constexpr value_type OctaveAmp = 1 / static_cast<value_type>(1ull << I);
+
 		[[nodiscard]]
 		static constexpr value_type Weight(std::int32_t octaves) noexcept
 		{
@@ -128,6 +328,8 @@ namespace siv
 			{
 				p[256 + i] = p[i];
 			}
+
+			widenTable();
 		}
 
 	# ifdef __cpp_lib_concepts
@@ -148,6 +350,8 @@ namespace siv
 			{
 				p[256 + i] = p[i];
 			}
+
+			widenTable();
 		}
 
 		///////////////////////////////////////
@@ -194,6 +398,54 @@ namespace siv
 				Grad(p[BB + 1], x - 1, y - 1, z - 1))));
 		}
 
+		//	noise2D() without the z = 0 half of the cube, equal to it up to the sign of a zero result
+		[[nodiscard]]
+		value_type gradientNoise2D(value_type x, value_type y) const noexcept
+		{
+			const std::int32_t X = static_cast<std::int32_t>(std::floor(x)) & 255;
+			const std::int32_t Y = static_cast<std::int32_t>(std::floor(y)) & 255;
+
+			x -= std::floor(x);
+			y -= std::floor(y);
+
+			const value_type u = Fade(x);
+			const value_type v = Fade(y);
+
+			const std::int32_t A = p[X] + Y, B = p[X + 1] + Y;
+
+			return Lerp(v, Lerp(u, Grad2(p[p[A]], x, y),
+				Grad2(p[p[B]], x - 1, y)),
+				Lerp(u, Grad2(p[p[A + 1]], x, y - 1),
+				Grad2(p[p[B + 1]], x - 1, y - 1)));
+		}
+
+		///////////////////////////////////////
+		//
+		//	Octave noise with the octave count fixed at compile time
+		//	* octaves are unrolled, same sum as accumulatedOctaveNoise2D(x, y, Octaves)
+		//
+		template <std::int32_t Octaves>
+		[[nodiscard]]
+		value_type octaveNoise2D(value_type x, value_type y) const noexcept
+		{
+			static_assert(Octaves > 0 && Octaves < 64, "octave count out of range");
+
+			return [&]<std::int32_t... I>(std::integer_sequence<std::int32_t, I...>)
+			{
+				value_type result = 0;
+				((result += gradientNoise2D(x * OctaveScale<I>, y * OctaveScale<I>) * OctaveAmp<I>), ...);
+				return result; // unnormalized
+			}(std::make_integer_sequence<std::int32_t, Octaves>{});
+		}
+
+		template <std::int32_t Octaves>
+		[[nodiscard]]
+		value_type normalizedOctaveNoise2D(value_type x, value_type y) const noexcept
+		{
+			constexpr value_type weight = Weight(Octaves);
+			return octaveNoise2D<Octaves>(x, y) / weight;
+		}
+
 		///////////////////////////////////////
 		//
 		//	Noise [0, 1]
@@ -275,6 +527,61 @@ namespace siv
 			return result; // unnormalized
 		}
 
+		///////////////////////////////////////
+		//
+		//	Batched noise, out[i] = f(x[i], y[i], ...)
+		//	* SIMD lanes for double (SSE2 x2, AVX2 x4), scalar elsewhere and for the tail
+		//
+		void noise3D(const value_type* x, const value_type* y, const value_type* z, value_type* out, std::size_t count) const noexcept
+		{
+			std::size_t i = 0;
+		# if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+			if constexpr (std::is_same_v<value_type, double>)
+			{
+				for (const std::size_t end = count - count % Lanes::size; i < end; i += Lanes::size)
+				{
+					Lanes::store(out + i, noise3DLanes(Lanes::load(x + i), Lanes::load(y + i), Lanes::load(z + i)));
+				}
+			}
+		# endif
+			for (; i < count; ++i)
+			{
+				out[i] = noise3D(x[i], y[i], z[i]);
+			}
+		}
+
+		void accumulatedOctaveNoise2D(const value_type* x, const value_type* y, value_type* out, std::size_t count, std::int32_t octaves) const noexcept
+		{
+			std::size_t i = 0;
+		# if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+			if constexpr (std::is_same_v<value_type, double>)
+			{
+				using L = Lanes;
+				const typename L::F zero = L::set1(0), two = L::set1(2);
+				for (const std::size_t end = count - count % L::size; i < end; i += L::size)
+				{
+					typename L::F lx = L::load(x + i), ly = L::load(y + i);
+					typename L::F result = zero;
+					value_type amp = 1;
+
+					for (std::int32_t o = 0; o < octaves; ++o)
+					{
+						result = L::add(result, L::mul(noise2DLanes(lx, ly), L::set1(amp)));
+						lx = L::mul(lx, two);
+						ly = L::mul(ly, two);
+						amp /= 2;
+					}
+
+					L::store(out + i, result);
+				}
+			}
+		# endif
+			for (; i < count; ++i)
+			{
+				out[i] = accumulatedOctaveNoise2D(x[i], y[i], octaves);
+			}
+		}
+
 		///////////////////////////////////////
 		//
 		//	Normalized octave noise [-1, 1]
@@ -368,6 +675,8 @@ namespace siv
 			{
 				p[256 + i] = p[i] = s[i];
 			}
+
+			widenTable();
 		}
 
 		///////////////////////////////////////
@@ -3,32 +3,64 @@ CONFIG += c++20
 CONFIG -= app_bundle
 CONFIG -= qt
 
-LIBS += -lSDL2 -lSDL2_image -lSDL2_mixer -lSDL2_net -lGL -lGLEW -lpthread
+LIBS += -lSDL2 -lSDL2_image -lSDL2_mixer -lSDL2_net -lGL -lGLEW -lpthread -lz
 
 SOURCES += \
+        biome.cpp \
         camera.cpp \
         chunk.cpp \
+        chunkpool.cpp \
+        chunkstore.cpp \
         client.cpp \
         dda.cpp \
         dist.cpp \
+        epoch.cpp \
         gamewindow.cpp \
+        jobsystem.cpp \
+        journal.cpp \
         main.cpp \
+        mappedfile.cpp \
         mdlmanager.cpp \
+        palette.cpp \
         ray.cpp \
+        regionfile.cpp \
+        residency.cpp \
         server.cpp \
         shadermanager.cpp \
-        texmanager.cpp
+        streamer.cpp \
+        terrain.cpp \
+        terraincache.cpp \
+        texmanager.cpp \
+        world.cpp \
+        worldgen.cpp \
+        worldsaver.cpp
 
 HEADERS += \
+  biome.hpp \
   camera.hpp \
   chunk.hpp \
+  chunkpool.hpp \
+  chunkstore.hpp \
   client.hpp \
   dda.hpp \
   dist.hpp \
+  epoch.hpp \
   gamewindow.hpp \
+  jobsystem.hpp \
+  journal.hpp \
+  mappedfile.hpp \
   mdlmanager.hpp \
+  palette.hpp \
   ray.hpp \
+  regionfile.hpp \
+  residency.hpp \
   server.hpp \
   shadermanager.hpp \
+  streamer.hpp \
+  terrain.hpp \
+  terraincache.hpp \
   texmanager.hpp \
+  world.hpp \
+  worldgen.hpp \
+  worldsaver.hpp \
   PerlinNoise.hpp
@@ -0,0 +1,1158 @@
+// Headless world generation benchmark, links only chunk, noise and generator code.
+//
+//   worldgen_bench [--seed N] [--columns N] [--threads N] [--no-caves] [--mask] [--lookup]
+//                  [--dump FILE] [--golden FILE [--update-golden]] [--regions DIR] [--save DIR]
+//                  [--journal DIR] [--stress SECONDS] [--palette] [--regen N]
+//
+// Generates a square of about N columns around the origin and prints
+// columns/s, ns per block, peak RSS and the world hash (World::hash).
+// --mask also times exposed-block detection with occupancy masks against a
+// per-block neighbor scan, --lookup times ChunkStore::get against a hash map.
+// --dump writes every chunk's position and content hash, for diffing runs.
+// --regen unloads and regenerates the world with N further seeds, printing
+// ChunkPool acquire/release/slab counts and resident memory after each.
+// --palette prints the bytes per chunk of the generated world and times
+// get/set on its chunks against the one byte per block vector chunks used to hold.
+// --golden generates each seed listed in FILE for this chunk size twice, on
+// one worker in order and on --threads workers in shuffled order, and fails
+// unless both match the stored world hash. --update-golden rewrites them.
+// --regions saves every chunk into region files under DIR, loads them back
+// through a fresh RegionStorage, checks the content hashes and times the
+// first change to each loaded chunk (a copy out of the mapping if mapped).
+// --save edits every chunk, times a synchronous save of all of them, then
+// runs 60 Hz edit ticks through a WorldSaver snapshot of the same world and
+// compares tick times during the background write with idle ones.
+// --journal times BlockJournal appends committed per change, per tick and
+// every JOURNAL_COMMIT_TICKS ticks, then journals edit ticks over a saved
+// world, drops everything without saving, tears the journal's tail, saves the
+// empty store the way startup does and times WorldSaver::recover on it against
+// the world hash before the crash.
+// --stress runs publishing, unloading, reading and reclaiming threads on one
+// ChunkStore for SECONDS and checks every chunk read and the pool count, then
+// times lookups under one writer against a mutex-guarded unordered_map.
+
+#include "chunkpool.hpp"
+#include "chunkstore.hpp"
+#include "jobsystem.hpp"
+#include "journal.hpp"
+#include "palette.hpp"
+#include "regionfile.hpp"
+#include "world.hpp"
+#include "worldgen.hpp"
+#include "worldsaver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point t)
+    {
+        return std::chrono::duration<double>(Clock::now() - t).count();
+    }
+
+    size_t peakRssKiB()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+            return 0;
+        return pmc.PeakWorkingSetSize / 1024;
+#else
+        struct rusage ru;
+        if(getrusage(RUSAGE_SELF, &ru) != 0)
+            return 0;
+#ifdef __APPLE__
+        return ru.ru_maxrss / 1024; // bytes there
+#else
+        return ru.ru_maxrss;
+#endif
+#endif
+    }
+
+    size_t currentRssKiB()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+            return 0;
+        return pmc.WorkingSetSize / 1024;
+#else
+        // resident pages are the second field, zero where there's no /proc
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        if(!(statm >> pages >> resident))
+            return 0;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+    }
+
+    uint64_t worldHash(ChunkStore &store, int side, int origin)
+    {
+        EpochGuard guard;
+        World world(store);
+        return world.hash(glm::ivec2(origin), glm::ivec2(origin + side - 1));
+    }
+
+    // request order is row-major, or shuffled with a fixed seed
+    double generate(ChunkStore &store, JobSystem &jobs, uint32_t seed, bool caves, int side, int origin, bool shuffle)
+    {
+        WorldGenerator gen(store, jobs, seed);
+        gen.setCaves(caves);
+
+        std::vector<glm::ivec2> order;
+        for(int x=0; x < side; x++)
+        {
+            for(int z=0; z < side; z++)
+                order.push_back(glm::ivec2(x + origin, z + origin));
+        }
+        if(shuffle)
+            std::shuffle(order.begin(), order.end(), std::mt19937(seed ^ 0x9e3779b9u));
+
+        Clock::time_point t = Clock::now();
+        std::vector<JobSystem::Handle> handles;
+        handles.reserve(order.size());
+        for(const glm::ivec2 &c : order)
+            handles.push_back(gen.request(c));
+        jobs.wait(handles);
+        const double elapsed = secondsSince(t);
+
+        gen.reset(seed); // drop the unpublished border before the workers go
+        return elapsed;
+    }
+
+    void unload(ChunkStore &store)
+    {
+        {
+            EpochGuard guard;
+            store.forEach([&](Chunk *ch) { ChunkStore::retire(ch); });
+        }
+        store.clear();
+        EpochManager::global().reclaim();
+    }
+
+    bool dumpChunks(ChunkStore &store, int side, int origin, const char *path)
+    {
+        FILE *f = fopen(path, "w");
+        if(f == nullptr)
+        {
+            fprintf(stderr, "can't write %s\n", path);
+            return false;
+        }
+        EpochGuard guard;
+        for(int x=0; x < side; x++)
+        {
+            for(int z=0; z < side; z++)
+            {
+                for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+                {
+                    const glm::ivec3 p(x + origin, y, z + origin);
+                    const Chunk *ch = store.get(p);
+                    fprintf(f, "%d %d %d %016llx\n", p.x, p.y, p.z,
+                            (unsigned long long)(ch ? ch->contentHash() : 0));
+                }
+            }
+        }
+        fclose(f);
+        return true;
+    }
+
+    struct GoldenEntry
+    {
+        int width, height, depth;
+        uint32_t seed;
+        int columns;
+        bool caves;
+        uint64_t hash;
+    };
+
+    // lines: chunk width height depth, seed, columns, caves, world hash; # comments
+    int runGolden(const char *path, bool update, unsigned threads)
+    {
+        std::vector<std::string> header;
+        std::vector<GoldenEntry> entries;
+        std::ifstream in(path);
+        std::string line;
+        while(std::getline(in, line))
+        {
+            if(line.empty() || line[0] == '#')
+            {
+                header.push_back(line);
+                continue;
+            }
+            GoldenEntry e;
+            int caves;
+            std::istringstream ls(line);
+            ls >> e.width >> e.height >> e.depth >> e.seed >> e.columns >> caves >> std::hex >> e.hash;
+            if(!ls)
+            {
+                fprintf(stderr, "bad golden line: %s\n", line.c_str());
+                return 1;
+            }
+            e.caves = caves != 0;
+            entries.push_back(e);
+        }
+
+        auto ours = [](const GoldenEntry &e)
+        {
+            return e.width == Chunk::WIDTH && e.height == Chunk::HEIGHT && e.depth == Chunk::DEPTH;
+        };
+        if(update && std::none_of(entries.begin(), entries.end(), ours))
+        {
+            for(uint32_t seed : {0u, 1u, 777u, 4242u, 123456789u})
+                entries.push_back({Chunk::WIDTH, Chunk::HEIGHT, Chunk::DEPTH, seed, 1089, true, 0});
+        }
+
+        int failed = 0, checked = 0;
+        for(GoldenEntry &e : entries)
+        {
+            if(!ours(e))
+                continue;
+
+            const int side = std::max(1, (int)std::lround(std::sqrt((double)e.columns)));
+            const int origin = -side / 2;
+            ChunkStore store;
+            uint64_t hashes[2];
+            for(int pass=0; pass < 2; pass++)
+            {
+                JobSystem jobs(pass == 0 ? 1 : threads);
+                generate(store, jobs, e.seed, e.caves, side, origin, pass == 1);
+                hashes[pass] = worldHash(store, side, origin);
+                unload(store);
+            }
+
+            const bool stable = hashes[0] == hashes[1];
+            const bool match = stable && (update || hashes[0] == e.hash);
+            printf("seed %u, %d columns, caves %s: %016llx %s\n", e.seed, side*side, e.caves ? "on" : "off",
+                   (unsigned long long)hashes[0],
+                   !stable ? "differs between runs" : (match ? "ok" : "MISMATCH"));
+            if(!match)
+                failed++;
+            else if(update)
+                e.hash = hashes[0];
+            checked++;
+        }
+
+        if(update && failed == 0)
+        {
+            FILE *f = fopen(path, "w");
+            if(f == nullptr)
+            {
+                fprintf(stderr, "can't write %s\n", path);
+                return 1;
+            }
+            if(header.empty())
+                header.push_back("# chunk width height depth, seed, columns, caves, world hash");
+            for(const std::string &h : header)
+                fprintf(f, "%s\n", h.c_str());
+            for(const GoldenEntry &e : entries)
+                fprintf(f, "%d %d %d %u %d %d %016llx\n", e.width, e.height, e.depth, e.seed, e.columns,
+                        e.caves ? 1 : 0, (unsigned long long)e.hash);
+            fclose(f);
+        }
+        printf("%d/%d golden worlds %s\n", checked - failed, checked, update ? "updated" : "match");
+        return (failed > 0 || checked == 0) ? 1 : 0;
+    }
+
+    bool benchRegions(ChunkStore &store, const char *dir)
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+
+        EpochGuard guard;
+        std::vector<Chunk*> chunks;
+        store.forEach([&](Chunk *ch) { chunks.push_back(ch); });
+        std::sort(chunks.begin(), chunks.end(), [](const Chunk *a, const Chunk *b)
+        {
+            return ChunkStore::packKey(a->getPos()) < ChunkStore::packKey(b->getPos());
+        });
+
+        RegionStorage::Stats ws, rs;
+        double saveTime, loadTime, cowTime;
+        {
+            RegionStorage storage(dir);
+            Clock::time_point t = Clock::now();
+            for(const Chunk *ch : chunks)
+                storage.save(ch);
+            saveTime = secondsSince(t);
+            ws = storage.stats();
+        }
+
+        size_t mismatched = 0;
+        {
+            RegionStorage storage(dir);
+            Clock::time_point t = Clock::now();
+            std::vector<Chunk*> loaded;
+            loaded.reserve(chunks.size());
+            for(const Chunk *ch : chunks)
+                loaded.push_back(storage.load(ch->getPos()));
+            loadTime = secondsSince(t);
+            rs = storage.stats();
+
+            for(size_t i=0; i < chunks.size(); i++)
+            {
+                if(loaded[i] == nullptr || loaded[i]->contentHash() != chunks[i]->contentHash())
+                    mismatched++;
+            }
+
+            // the first change copies a mapped chunk's blocks out of the file
+            t = Clock::now();
+            for(Chunk *ch : loaded)
+            {
+                if(ch != nullptr)
+                    ch->setBlockAt(0, ch->getBlockAt(0) == 1 ? 2 : 1);
+            }
+            cowTime = secondsSince(t);
+            for(Chunk *ch : loaded)
+            {
+                if(ch != nullptr)
+                    ChunkPool::instance().release(ch);
+            }
+        }
+
+        uintmax_t fileBytes = 0;
+        size_t files = 0;
+        for(const auto &entry : std::filesystem::directory_iterator(dir, ec))
+        {
+            fileBytes += entry.file_size();
+            files++;
+        }
+
+        const double mib = 1024.0 * 1024.0;
+        printf("regions: %zu chunks in %zu files, %.2f MiB on disk (%.1f%% of raw)\n",
+               chunks.size(), files, fileBytes / mib, 100.0 * fileBytes / std::max<size_t>(ws.bytesWritten, 1));
+        printf("  save %.0f chunks/s, %.1f MiB/s; load %.0f chunks/s, %.1f MiB/s\n",
+               ws.saved / saveTime, ws.bytesWritten / mib / saveTime, rs.loaded / loadTime, rs.bytesRead / mib / loadTime);
+        printf("  %zu mapped, %.2f us avg / %.1f us max per load, %zu minor / %zu major faults\n",
+               rs.mapped, rs.avgLoadUs, rs.maxLoadUs, rs.minorFaults, rs.majorFaults);
+        printf("  first change %.0f ns/chunk, %zu copied out of the mapping\n",
+               cowTime*1e9 / std::max<size_t>(chunks.size(), 1), PalettedStorage<Chunk::VOLUME>::promotions() - rs.promoted);
+        printf("  %zu failed, %zu mismatched\n", ws.failed + rs.failed, mismatched);
+        return ws.failed + rs.failed == 0 && mismatched == 0;
+    }
+
+    struct TickTimes
+    {
+        std::vector<double> ms;
+
+        double avg() const { return ms.empty() ? 0.0 : std::accumulate(ms.begin(), ms.end(), 0.0) / ms.size(); }
+        double max() const { return ms.empty() ? 0.0 : *std::max_element(ms.begin(), ms.end()); }
+        double p99() const
+        {
+            if(ms.empty())
+                return 0.0;
+            std::vector<double> s = ms;
+            std::sort(s.begin(), s.end());
+            return s[std::min(s.size() - 1, s.size() * 99 / 100)];
+        }
+    };
+
+    bool benchSave(ChunkStore &store, int side, int origin, const char *dir)
+    {
+        const int editsPerTick = 64;
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+        const std::string syncDir = std::string(dir) + "/sync", asyncDir = std::string(dir) + "/async";
+
+        // one edit per chunk dirties the whole world
+        std::vector<Chunk*> chunks;
+        {
+            EpochGuard guard;
+            store.forEach([&](Chunk *ch) { chunks.push_back(ch); });
+        }
+        for(Chunk *ch : chunks)
+            ch->setBlockAt(0, ch->getBlockAt(0) == 1 ? 2 : 1);
+
+        // what saving on the main loop stalls it for
+        double syncMs;
+        {
+            RegionStorage storage(syncDir);
+            Clock::time_point t = Clock::now();
+            for(const Chunk *ch : chunks)
+                storage.save(ch);
+            syncMs = secondsSince(t) * 1e3;
+        }
+
+        RegionStorage storage(asyncDir);
+        WorldSaver saver(store, &storage);
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> xz(origin * Chunk::WIDTH, (origin + side) * Chunk::WIDTH - 1);
+        std::uniform_int_distribution<int> y(0, WORLD_HEIGHT - 1), id(0, 7);
+        // ticks are paced like the game loop, the writer gets the rest of each frame
+        const Clock::duration period = std::chrono::microseconds(1000000 / 60);
+        Clock::time_point next = Clock::now();
+        auto tick = [&](TickTimes &times)
+        {
+            std::this_thread::sleep_until(next);
+            next += period;
+            Clock::time_point t = Clock::now();
+            {
+                EpochGuard guard;
+                World world(store);
+                for(int i=0; i < editsPerTick; i++)
+                    world.setBlock(glm::ivec3(xz(rng), y(rng), xz(rng)), id(rng));
+            }
+            const bool finished = saver.poll();
+            EpochManager::global().reclaim();
+            times.ms.push_back(secondsSince(t) * 1e3);
+            return finished;
+        };
+
+        TickTimes idle, saving;
+        for(int i=0; i < 60; i++)
+            tick(idle);
+
+        // what the snapshot must contain
+        std::unordered_map<uint64_t, uint64_t> expected;
+        {
+            EpochGuard guard;
+            store.forEach([&](Chunk *ch)
+            {
+                if(ch->isModified())
+                    expected[ChunkStore::packKey(ch->getPos())] = ch->contentHash();
+            });
+        }
+
+        Clock::time_point t = Clock::now();
+        saver.capture();
+        const double captureMs = secondsSince(t) * 1e3;
+        while(!tick(saving))
+            ;
+        const WorldSaver::Stats st = saver.stats();
+
+        size_t mismatched = 0, dirty = 0;
+        {
+            RegionStorage reread(asyncDir);
+            EpochGuard guard;
+            store.forEach([&](Chunk *ch)
+            {
+                if(ch->isModified())
+                    dirty++;
+                auto it = expected.find(ChunkStore::packKey(ch->getPos()));
+                if(it == expected.end())
+                    return;
+                Chunk *saved = reread.load(ch->getPos());
+                if(saved == nullptr || saved->contentHash() != it->second)
+                    mismatched++;
+                if(saved != nullptr)
+                    ChunkPool::instance().release(saved);
+            });
+        }
+
+        printf("save: %zu dirty chunks, synchronous save %.1f ms\n", expected.size(), syncMs);
+        printf("  snapshot captured in %.2f ms, written in %.1f ms over %zu ticks of %d edits, %zu chunks copied by edits\n",
+               captureMs, st.writeMs, saving.ms.size(), editsPerTick, st.detached);
+        printf("  tick ms idle avg %.3f / p99 %.3f / max %.3f, saving avg %.3f / p99 %.3f / max %.3f\n",
+               idle.avg(), idle.p99(), idle.max(), saving.avg(), saving.p99(), saving.max());
+        printf("  %zu chunks still dirty after the save, %zu failed, %zu mismatched\n", dirty, st.failed, mismatched);
+        return st.failed == 0 && mismatched == 0;
+    }
+
+    size_t journalFiles(const std::string &dir)
+    {
+        size_t n = 0;
+        std::error_code ec;
+        for(const auto &e : std::filesystem::directory_iterator(dir, ec))
+            n += e.path().filename().string().rfind("journal.", 0) == 0;
+        return n;
+    }
+
+    bool benchJournal(ChunkStore &store, uint32_t seed, bool caves, unsigned threads, int side, int origin, const char *dir)
+    {
+        const int editsPerTick = 64, ticks = 600;
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> xz(origin * Chunk::WIDTH, (origin + side) * Chunk::WIDTH - 1);
+        std::uniform_int_distribution<int> y(0, WORLD_HEIGHT - 1), id(0, 7);
+
+        // throughput, unpaced; group commit folds whatever queued during a sync into one batch
+        // the first mode waits for every sync, what a journal without group commit costs
+        struct Mode { std::string name; int records, every; bool wait; };
+        const Mode modes[] = {
+            {"and sync each", 1024, 1, true},
+            {"per change", 4096, 1, false},
+            {"per tick", 64 * 1024, editsPerTick, false},
+            {"per " + std::to_string(JOURNAL_COMMIT_TICKS) + " ticks", 256 * 1024, editsPerTick * JOURNAL_COMMIT_TICKS, false},
+        };
+        printf("journal: %d edits per tick\n", editsPerTick);
+        for(const Mode &m : modes)
+        {
+            BlockJournal journal(std::string(dir) + "/throughput");
+            Clock::time_point t = Clock::now();
+            for(int i=0; i < m.records; i++)
+            {
+                journal.append(glm::ivec3(xz(rng), y(rng), xz(rng)), id(rng));
+                if(m.wait)
+                    journal.flush();
+                else if((i + 1) % m.every == 0)
+                    journal.commit();
+            }
+            journal.flush();
+            const double elapsed = secondsSince(t);
+            const BlockJournal::Stats st = journal.stats();
+            printf("  commit %-14s %8.0f changes/s, %6.2f MB/s, %zu commits in %zu syncs, %.2f ms avg / %.2f ms max per sync\n",
+                   m.name.c_str(), m.records / elapsed, st.bytes / elapsed / 1e6, (size_t)(m.records + m.every - 1) / m.every,
+                   st.syncs, st.avgCommitMs, st.maxCommitMs);
+            std::filesystem::remove_all(std::string(dir) + "/throughput", ec);
+        }
+
+        // a clean world, then edits journaled like the game loop does, a snapshot half way
+        const std::string worldDir = std::string(dir) + "/world";
+        JobSystem jobs(threads);
+        unload(store);
+        generate(store, jobs, seed, caves, side, origin, false);
+        uint64_t expected;
+        size_t journaled = 0;
+        {
+            RegionStorage storage(worldDir);
+            BlockJournal journal(worldDir);
+            WorldSaver saver(store, &storage);
+            saver.setJournal(&journal);
+            for(int tick=0; tick < ticks; tick++)
+            {
+                {
+                    EpochGuard guard;
+                    World world(store);
+                    for(int i=0; i < editsPerTick; i++)
+                    {
+                        const glm::ivec3 pos(xz(rng), y(rng), xz(rng));
+                        const int bid = id(rng);
+                        if(world.setBlock(pos, bid))
+                            journal.append(pos, bid);
+                    }
+                }
+                if(tick % JOURNAL_COMMIT_TICKS == 0)
+                    journal.commit();
+                if(tick == ticks / 2)
+                {
+                    saver.capture();
+                    saver.flush();
+                }
+                saver.poll();
+                EpochManager::global().reclaim();
+            }
+            journal.flush(); // the last group commit made it, the edits after it never happened
+            journaled = journal.stats().committed;
+            expected = worldHash(store, side, origin);
+        }
+        // the crash: nothing saved past the snapshot
+        unload(store);
+
+        // a torn batch at the end of the newest segment
+        std::vector<std::filesystem::path> segs;
+        for(const auto &e : std::filesystem::directory_iterator(worldDir, ec))
+        {
+            if(e.path().filename().string().rfind("journal.", 0) == 0)
+                segs.push_back(e.path());
+        }
+        std::sort(segs.begin(), segs.end());
+        const size_t pending = journalFiles(worldDir);
+        if(!segs.empty())
+        {
+            std::ofstream torn(segs.back(), std::ios::binary | std::ios::app);
+            const uint32_t header[4] = {1000, 0xdeadbeef, 1, 2};
+            torn.write((const char*)header, sizeof(header));
+        }
+
+        Clock::time_point t = Clock::now();
+        size_t applied, kept, left;
+        double recoverMs;
+        {
+            RegionStorage storage(worldDir);
+            BlockJournal journal(worldDir);
+            WorldSaver saver(store, &storage);
+            saver.setJournal(&journal);
+            WorldGenerator gen(store, jobs, seed);
+            gen.setCaves(caves);
+            gen.setStorage(&storage);
+            // a save of the empty store first, like GameWindow::saveWorld, and time for its drop to run
+            saver.flush();
+            saver.capture();
+            saver.flush();
+            journal.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            kept = journalFiles(worldDir);
+            applied = saver.recover(gen, jobs);
+            recoverMs = secondsSince(t) * 1e3;
+
+            // the rest of the area, saved chunks replace generated ones
+            std::vector<JobSystem::Handle> handles;
+            for(int x=0; x < side; x++)
+            {
+                for(int z=0; z < side; z++)
+                    handles.push_back(gen.request(glm::ivec2(x + origin, z + origin)));
+            }
+            jobs.wait(handles);
+            gen.reset(seed);
+            journal.flush();
+            left = journalFiles(worldDir);
+        }
+        const uint64_t recovered = worldHash(store, side, origin);
+
+        printf("  recovery: %zu changes journaled over %d ticks in %zu segments, %zu replayed in %.1f ms (%.1f us/change)\n",
+               journaled, ticks, pending, applied, recoverMs, applied > 0 ? recoverMs * 1e3 / applied : 0.0);
+        printf("  %zu of %zu segments kept by a save before recovery\n", kept, pending);
+        printf("  world hash %016llx before the crash, %016llx recovered, %zu journal segments left\n",
+               (unsigned long long)expected, (unsigned long long)recovered, left);
+        return expected == recovered && kept == pending && left == 0;
+    }
+
+    // every block of a stress chunk is this, readers check it
+    int stressTag(const glm::ivec3 &cpos)
+    {
+        return 1 + ((cpos.x * 31 + cpos.y * 17 + cpos.z * 7) & 0xff);
+    }
+
+    glm::ivec3 stressPos(std::mt19937 &rng, int side)
+    {
+        std::uniform_int_distribution<int> xz(0, side - 1), y(0, Chunk::COLUMN_HEIGHT - 1);
+        return glm::ivec3(xz(rng), y(rng), xz(rng));
+    }
+
+    Chunk *stressChunk(const glm::ivec3 &cpos)
+    {
+        std::vector<uint16_t> blocks(Chunk::VOLUME, stressTag(cpos));
+        return Chunk::fromBlocks(cpos, blocks.data());
+    }
+
+    // what the store replaced: one lock around an unordered_map
+    struct LockedStore
+    {
+        std::mutex lock;
+        std::unordered_map<uint64_t, Chunk*> map;
+    };
+
+    bool benchStress(double seconds)
+    {
+        const int side = 16;
+        const size_t before = ChunkPool::instance().stats().inUse;
+
+        // stress: 3 publishers, 1 unloader, 3 readers and a reclaimer
+        ChunkStore store;
+        std::atomic<bool> stop(false);
+        std::atomic<size_t> reads(0), hits(0), bad(0), writes(0);
+        std::vector<std::thread> threads;
+        for(int w=0; w < 3; w++)
+        {
+            threads.emplace_back([&, w]
+            {
+                std::mt19937 rng(100 + w);
+                size_t n = 0;
+                while(!stop)
+                {
+                    const glm::ivec3 cpos = stressPos(rng, side);
+                    Chunk *old = store.set(cpos, stressChunk(cpos));
+                    if(old != nullptr)
+                        ChunkStore::retire(old);
+                    n++;
+                }
+                writes += n;
+            });
+        }
+        threads.emplace_back([&]
+        {
+            std::mt19937 rng(200);
+            while(!stop)
+            {
+                Chunk *old = store.remove(stressPos(rng, side));
+                if(old != nullptr)
+                    ChunkStore::retire(old);
+            }
+        });
+        for(int r=0; r < 3; r++)
+        {
+            threads.emplace_back([&, r]
+            {
+                std::mt19937 rng(300 + r);
+                size_t n = 0, found = 0, wrong = 0;
+                while(!stop)
+                {
+                    EpochGuard guard;
+                    for(int i=0; i < 64; i++, n++)
+                    {
+                        const glm::ivec3 cpos = stressPos(rng, side);
+                        const Chunk *ch = store.get(cpos);
+                        if(ch == nullptr)
+                            continue;
+                        found++;
+                        if(ch->getPos() != cpos || ch->getBlockAt((int)(rng() % Chunk::VOLUME)) != stressTag(cpos))
+                            wrong++;
+                    }
+                }
+                reads += n;
+                hits += found;
+                bad += wrong;
+            });
+        }
+        threads.emplace_back([&]
+        {
+            while(!stop)
+            {
+                EpochManager::global().reclaim();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for(std::thread &t : threads)
+            t.join();
+        threads.clear();
+
+        EpochManager::global().reclaim();
+        const size_t live = ChunkPool::instance().stats().inUse - before;
+        const size_t stored = store.size();
+        unload(store);
+        const size_t leaked = ChunkPool::instance().stats().inUse - before;
+        printf("stress: %.1f s, %zu publishes, %zu reads (%zu hits), %zu bad reads\n",
+               seconds, writes.load(), reads.load(), hits.load(), bad.load());
+        printf("  %zu chunks in the store, %zu pool records in use after reclaim, %zu after unload\n",
+               stored, live, leaked);
+        bool ok = bad == 0 && live == stored && leaked == 0;
+
+        // contention: readers against one writer replacing chunks as fast as it can
+        const double slice = std::max(0.2, seconds / 8);
+        printf("  lookups/s with one writer, %u hardware threads:\n", std::thread::hardware_concurrency());
+        for(int readers : {1, 2, 4})
+        {
+            double rate[2], writeRate[2];
+            for(int locked=0; locked < 2; locked++)
+            {
+                LockedStore map;
+                for(int x=0; x < side; x++)
+                {
+                    for(int z=0; z < side; z++)
+                    {
+                        for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+                        {
+                            const glm::ivec3 cpos(x, y, z);
+                            if(locked)
+                                map.map[ChunkStore::packKey(cpos)] = stressChunk(cpos);
+                            else
+                                store.set(cpos, stressChunk(cpos));
+                        }
+                    }
+                }
+
+                stop = false;
+                reads = 0;
+                writes = 0;
+                bad = 0;
+                threads.emplace_back([&]
+                {
+                    std::mt19937 rng(400);
+                    size_t n = 0;
+                    while(!stop)
+                    {
+                        const glm::ivec3 cpos = stressPos(rng, side);
+                        Chunk *ch = stressChunk(cpos);
+                        if(locked)
+                        {
+                            std::unique_lock<std::mutex> lk(map.lock);
+                            std::swap(map.map[ChunkStore::packKey(cpos)], ch);
+                            lk.unlock();
+                            ChunkPool::instance().release(ch);
+                        }
+                        else
+                        {
+                            ChunkStore::retire(store.set(cpos, ch));
+                            if(n % 256 == 0)
+                                EpochManager::global().reclaim();
+                        }
+                        n++;
+                    }
+                    writes += n;
+                });
+                for(int r=0; r < readers; r++)
+                {
+                    threads.emplace_back([&, r]
+                    {
+                        std::mt19937 rng(500 + r);
+                        size_t n = 0, wrong = 0;
+                        while(!stop)
+                        {
+                            EpochGuard guard;
+                            for(int i=0; i < 64; i++, n++)
+                            {
+                                const glm::ivec3 cpos = stressPos(rng, side);
+                                const int idx = (int)(rng() % Chunk::VOLUME);
+                                int id;
+                                if(locked)
+                                {
+                                    std::lock_guard<std::mutex> lk(map.lock);
+                                    id = map.map[ChunkStore::packKey(cpos)]->getBlockAt(idx);
+                                }
+                                else
+                                {
+                                    id = store.get(cpos)->getBlockAt(idx);
+                                }
+                                wrong += id != stressTag(cpos);
+                            }
+                        }
+                        reads += n;
+                        bad += wrong;
+                    });
+                }
+
+                std::this_thread::sleep_for(std::chrono::duration<double>(slice));
+                stop = true;
+                for(std::thread &t : threads)
+                    t.join();
+                threads.clear();
+                rate[locked] = reads / slice;
+                writeRate[locked] = writes / slice;
+                ok = ok && bad == 0;
+
+                for(auto &p : map.map)
+                    ChunkPool::instance().release(p.second);
+                unload(store);
+            }
+            printf("    %d readers: store %.2f M (writer %.0f k/s), mutex %.2f M (writer %.0f k/s)\n",
+                   readers, rate[0] / 1e6, writeRate[0] / 1e3, rate[1] / 1e6, writeRate[1] / 1e3);
+        }
+        return ok;
+    }
+
+    // reference for Chunk::exposed(), neighbors looked up block by block
+    size_t scanExposed(ChunkStore &store, const Chunk *ch)
+    {
+        const glm::ivec3 base = ch->getPos() * Chunk::size();
+        size_t count = 0;
+        for(int x=0; x < Chunk::WIDTH; x++)
+        {
+            for(int y=0; y < Chunk::HEIGHT; y++)
+            {
+                for(int z=0; z < Chunk::DEPTH; z++)
+                {
+                    if(ch->getBlockAt(Chunk::index(x, y, z)) == 0)
+                        continue;
+                    for(int f=0; f < Chunk::FACE_COUNT; f++)
+                    {
+                        const glm::ivec3 w = base + glm::ivec3(x, y, z) + Chunk::faceNormal(f);
+                        if(w.y < 0)
+                            continue;
+                        const Chunk *nb = store.get(Chunk::toChunkPos(w));
+                        const glm::ivec3 l = Chunk::toLocalPos(w);
+                        if(nb == nullptr || nb->getBlockAt(Chunk::index(l.x, l.y, l.z)) == 0)
+                        {
+                            count++;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    // the pool should stop growing after the first world, released records are reused
+    void benchRegen(ChunkStore &store, uint32_t seed, bool caves, unsigned threads, int side, int origin, int reseeds)
+    {
+        JobSystem jobs(threads);
+        ChunkPool::Stats last = ChunkPool::instance().stats();
+        printf("regen: %d reseeds of %d columns\n", reseeds, side * side);
+        printf("  %-10s %9s %9s %9s %6s %9s %9s\n", "seed", "acquired", "released", "in use", "slabs", "gen ms", "rss KiB");
+        for(int i=1; i <= reseeds; i++)
+        {
+            unload(store);
+            const double elapsed = generate(store, jobs, seed + i, caves, side, origin, false);
+            const ChunkPool::Stats ps = ChunkPool::instance().stats();
+            printf("  %-10u %9zu %9zu %9zu %6zu %9.1f %9zu\n", seed + i, ps.acquired - last.acquired,
+                   ps.released - last.released, ps.inUse, ps.slabs, elapsed * 1e3, currentRssKiB());
+            last = ps;
+        }
+    }
+
+    void benchPalette(ChunkStore &store)
+    {
+        typedef PalettedStorage<Chunk::VOLUME> Storage;
+        const size_t vectorBytes = sizeof(std::vector<uint8_t>) + Chunk::VOLUME;
+
+        std::vector<Storage> paletted;
+        std::vector<std::vector<uint8_t>> vectors;
+        size_t bytes = 0, chunks = 0, uniform = 0;
+        int bitsCount[17] = {0};
+        {
+            EpochGuard guard;
+            store.forEach([&](Chunk *ch)
+            {
+                const Storage &st = ch->storage();
+                bytes += st.memoryUsage();
+                chunks++;
+                bitsCount[st.bits()]++;
+                if(st.isUniform())
+                {
+                    uniform++;
+                    return;
+                }
+                // the timed set, mixed chunks only
+                if(paletted.size() < 1024)
+                {
+                    paletted.push_back(st);
+                    std::vector<uint8_t> v(Chunk::VOLUME);
+                    for(int i=0; i < Chunk::VOLUME; i++)
+                        v[i] = st.get(i);
+                    vectors.push_back(std::move(v));
+                }
+            });
+        }
+        if(chunks == 0 || paletted.empty())
+            return;
+
+        printf("palette: %zu chunks, %.1f bytes/chunk paletted vs %zu as vector<uint8_t> (%.1f%%), %zu uniform\n",
+               chunks, (double)bytes / chunks, vectorBytes, 100.0 * bytes / (chunks * vectorBytes), uniform);
+        printf("  index bits:");
+        for(int b=0; b <= 16; b++)
+        {
+            if(bitsCount[b] > 0)
+                printf(" %d: %d", b, bitsCount[b]);
+        }
+        printf("\n");
+
+        std::mt19937 rng(3);
+        const size_t ops = 1 << 22;
+        std::vector<uint32_t> at(ops);
+        std::vector<uint8_t> ids(ops);
+        for(size_t i=0; i < ops; i++)
+        {
+            at[i] = (rng() % paletted.size()) * Chunk::VOLUME + rng() % Chunk::VOLUME;
+            ids[i] = rng() % 8; // ids the generator uses, palettes rarely grow
+        }
+
+        uint64_t sum[2] = {0, 0};
+        double ns[2][3];
+        size_t repacks = 0;
+        for(int v=0; v < 2; v++)
+        {
+            // random get
+            Clock::time_point t = Clock::now();
+            for(size_t i=0; i < ops; i++)
+            {
+                const size_t c = at[i] / Chunk::VOLUME, idx = at[i] % Chunk::VOLUME;
+                sum[v] += v ? vectors[c][idx] : paletted[c].get(idx);
+            }
+            ns[v][0] = secondsSince(t) * 1e9 / ops;
+
+            // every block of every chunk in order, what meshing and hashing do
+            t = Clock::now();
+            for(size_t c=0; c < paletted.size(); c++)
+            {
+                for(int idx=0; idx < Chunk::VOLUME; idx++)
+                    sum[v] += v ? vectors[c][idx] : paletted[c].get(idx);
+            }
+            ns[v][1] = secondsSince(t) * 1e9 / (paletted.size() * Chunk::VOLUME);
+
+            // random set
+            if(!v)
+                repacks = Storage::repacks();
+            t = Clock::now();
+            for(size_t i=0; i < ops; i++)
+            {
+                const size_t c = at[i] / Chunk::VOLUME, idx = at[i] % Chunk::VOLUME;
+                if(v)
+                    vectors[c][idx] = ids[i];
+                else
+                    paletted[c].set(idx, ids[i]);
+            }
+            ns[v][2] = secondsSince(t) * 1e9 / ops;
+            if(!v)
+                repacks = Storage::repacks() - repacks;
+        }
+        for(size_t c=0; c < paletted.size(); c++)
+        {
+            for(int idx=0; idx < Chunk::VOLUME; idx++)
+                sum[0] += (paletted[c].get(idx) != vectors[c][idx]);
+        }
+
+        printf("  %zu mixed chunks, ns per block: get random %.2f / sequential %.2f / set random %.2f paletted, "
+               "%.2f / %.2f / %.2f vector%s\n",
+               paletted.size(), ns[0][0], ns[0][1], ns[0][2], ns[1][0], ns[1][1], ns[1][2],
+               sum[0] != sum[1] ? " (mismatch)" : "");
+        printf("  %zu repacks over %zu sets\n", repacks, ops);
+    }
+
+    void benchMask(ChunkStore &store)
+    {
+        EpochGuard guard;
+        std::vector<Chunk*> chunks;
+        store.forEach([&](Chunk *ch) { chunks.push_back(ch); });
+
+        Clock::time_point t = Clock::now();
+        size_t maskCount = 0;
+        for(const Chunk *ch : chunks)
+        {
+            const Chunk::Mask *nb[Chunk::FACE_COUNT];
+            for(int f=0; f < Chunk::FACE_COUNT; f++)
+            {
+                const glm::ivec3 p = ch->getPos() + Chunk::faceNormal(f);
+                const Chunk *n = store.get(p);
+                nb[f] = n ? &n->occupancy() : (p.y < 0 ? &Chunk::fullMask() : nullptr);
+            }
+            maskCount += ch->exposed(nb).count();
+        }
+        const double maskTime = secondsSince(t);
+
+        t = Clock::now();
+        size_t scanCount = 0;
+        for(const Chunk *ch : chunks)
+            scanCount += scanExposed(store, ch);
+        const double scanTime = secondsSince(t);
+
+        printf("mask: %zu chunks, masks %.1f ns/chunk, scan %.1f ns/chunk (%.1fx), exposed %zu/%zu\n",
+               chunks.size(), maskTime*1e9 / chunks.size(), scanTime*1e9 / chunks.size(),
+               scanTime / maskTime, maskCount, scanCount);
+    }
+
+    void benchLookup(ChunkStore &store, int side, int origin)
+    {
+        EpochGuard guard;
+        std::unordered_map<uint64_t, Chunk*> map;
+        store.forEach([&](Chunk *ch) { map[ChunkStore::packKey(ch->getPos())] = ch; });
+
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int> xz(origin, origin + side - 1), y(0, Chunk::COLUMN_HEIGHT - 1);
+        std::vector<glm::ivec3> keys(1 << 20);
+        for(glm::ivec3 &k : keys)
+            k = glm::ivec3(xz(rng), y(rng), xz(rng));
+
+        uintptr_t sink = 0;
+        Clock::time_point t = Clock::now();
+        for(const glm::ivec3 &k : keys)
+            sink += (uintptr_t)store.get(k);
+        const double storeTime = secondsSince(t);
+
+        t = Clock::now();
+        for(const glm::ivec3 &k : keys)
+        {
+            auto it = map.find(ChunkStore::packKey(k));
+            sink -= (uintptr_t)(it == map.end() ? nullptr : it->second);
+        }
+        const double mapTime = secondsSince(t);
+
+        printf("lookup: store %.1f ns, unordered_map %.1f ns%s\n",
+               storeTime*1e9 / keys.size(), mapTime*1e9 / keys.size(), sink ? " (mismatch)" : "");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seed = 0;
+    int columns = 4096;
+    unsigned threads = 0;
+    bool caves = true, mask = false, lookup = false, updateGolden = false;
+    const char *dump = nullptr, *golden = nullptr, *regions = nullptr, *save = nullptr, *journal = nullptr;
+    double stress = 0.0;
+    bool palette = false;
+    int regen = 0;
+
+    for(int i=1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--seed") == 0 && (i+1) < argc)
+            seed = strtoul(argv[++i], nullptr, 10);
+        else if(strcmp(argv[i], "--columns") == 0 && (i+1) < argc)
+            columns = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--threads") == 0 && (i+1) < argc)
+            threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--no-caves") == 0)
+            caves = false;
+        else if(strcmp(argv[i], "--regen") == 0 && (i+1) < argc)
+            regen = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--palette") == 0)
+            palette = true;
+        else if(strcmp(argv[i], "--mask") == 0)
+            mask = true;
+        else if(strcmp(argv[i], "--lookup") == 0)
+            lookup = true;
+        else if(strcmp(argv[i], "--dump") == 0 && (i+1) < argc)
+            dump = argv[++i];
+        else if(strcmp(argv[i], "--golden") == 0 && (i+1) < argc)
+            golden = argv[++i];
+        else if(strcmp(argv[i], "--update-golden") == 0)
+            updateGolden = true;
+        else if(strcmp(argv[i], "--regions") == 0 && (i+1) < argc)
+            regions = argv[++i];
+        else if(strcmp(argv[i], "--save") == 0 && (i+1) < argc)
+            save = argv[++i];
+        else if(strcmp(argv[i], "--journal") == 0 && (i+1) < argc)
+            journal = argv[++i];
+        else if(strcmp(argv[i], "--stress") == 0 && (i+1) < argc)
+            stress = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--seed N] [--columns N] [--threads N] [--no-caves] [--mask] [--lookup] "
+                            "[--dump FILE] [--golden FILE [--update-golden]] [--regions DIR] [--save DIR] "
+                            "[--journal DIR] [--stress SECONDS] [--palette] [--regen N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(golden != nullptr)
+        return runGolden(golden, updateGolden, threads);
+    if(stress > 0.0)
+        return benchStress(stress) ? 0 : 1;
+
+    const int side = std::max(1, (int)std::lround(std::sqrt((double)std::max(columns, 1))));
+    const int origin = -side / 2;
+    columns = side * side;
+
+    ChunkStore store;
+    {
+        Clock::time_point t = Clock::now();
+        JobSystem jobs(threads);
+        const double startup = secondsSince(t);
+        const double elapsed = generate(store, jobs, seed, caves, side, origin, false);
+
+        const double blocks = (double)columns * WORLD_HEIGHT * Chunk::WIDTH * Chunk::DEPTH;
+        printf("seed %u, %d columns of %dx%dx%d, %u workers, caves %s\n",
+               seed, columns, Chunk::WIDTH, WORLD_HEIGHT, Chunk::DEPTH, jobs.workerCount(), caves ? "on" : "off");
+        printf("startup %.2f ms, generated in %.1f ms: %.0f columns/s, %.2f ns/block\n",
+               startup*1e3, elapsed*1e3, columns / elapsed, elapsed*1e9 / blocks);
+    }
+
+    ChunkPool::Stats ps = ChunkPool::instance().stats();
+    printf("peak rss %zu KiB, %zu chunks in %zu slabs\n", peakRssKiB(), store.size(), ps.slabs);
+    printf("hash %016llx\n", (unsigned long long)worldHash(store, side, origin));
+    if(dump != nullptr && !dumpChunks(store, side, origin, dump))
+        return 1;
+
+    if(palette)
+        benchPalette(store);
+    if(regen > 0)
+        benchRegen(store, seed, caves, threads, side, origin, regen);
+    if(mask)
+        benchMask(store);
+    if(lookup)
+        benchLookup(store, side, origin);
+    const bool regionsOk = regions == nullptr || benchRegions(store, regions);
+    const bool saveOk = save == nullptr || benchSave(store, side, origin, save);
+    const bool journalOk = journal == nullptr || benchJournal(store, seed, caves, threads, side, origin, journal);
+
+    unload(store);
+    return (regionsOk && saveOk && journalOk) ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+TEMPLATE = app
+TARGET = worldgen_bench
+CONFIG += c++20 console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+LIBS += -lpthread -lz
+win32:LIBS += -lpsapi
+
+SOURCES += \
+        ../biome.cpp \
+        ../chunk.cpp \
+        ../chunkpool.cpp \
+        ../chunkstore.cpp \
+        ../epoch.cpp \
+        ../jobsystem.cpp \
+        ../journal.cpp \
+        ../mappedfile.cpp \
+        ../palette.cpp \
+        ../regionfile.cpp \
+        ../terrain.cpp \
+        ../terraincache.cpp \
+        ../world.cpp \
+        ../worldgen.cpp \
+        ../worldsaver.cpp \
+        worldgen_bench.cpp
+
+HEADERS += \
+  ../biome.hpp \
+  ../chunk.hpp \
+  ../chunkpool.hpp \
+  ../chunkstore.hpp \
+  ../epoch.hpp \
+  ../jobsystem.hpp \
+  ../journal.hpp \
+  ../mappedfile.hpp \
+  ../palette.hpp \
+  ../regionfile.hpp \
+  ../terrain.hpp \
+  ../terraincache.hpp \
+  ../world.hpp \
+  ../worldgen.hpp \
+  ../worldsaver.hpp \
+  ../PerlinNoise.hpp
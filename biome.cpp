@@ -0,0 +1,214 @@
+#include "biome.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const BiomeBlocks biomeTable[BIOME_COUNT] =
+    {
+        {"plains", 2, 3, 4}, // grass, dirt down to half the surface height
+        {"barren", 3, 3, 6}, // dirt
+        {"rocky",  1, 1, 8}, // stone all the way
+        {"scree",  4, 4, 7}, // cobblestone
+    };
+
+    // splitmix64 finalizer
+    inline uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    inline uint64_t packKey(const glm::ivec2 &p)
+    {
+        return ((uint64_t)(uint32_t)p.x << 32) | (uint32_t)p.y;
+    }
+}
+
+BiomeMap::BiomeMap(uint32_t seed)
+    : m_temperature(seed ^ 0x68e31da4u), m_humidity(seed ^ 0xb5297a4du), m_seed(seed), m_useCounter(0)
+{
+
+}
+
+uint32_t BiomeMap::seed() const
+{
+    return m_seed;
+}
+
+const BiomeBlocks &BiomeMap::blocks(int biome)
+{
+    return biomeTable[(unsigned)biome < BIOME_COUNT ? biome : BIOME_PLAINS];
+}
+
+const char *BiomeMap::name(int biome)
+{
+    return blocks(biome).name;
+}
+
+uint64_t BiomeMap::regionKey(const glm::ivec2 &rpos)
+{
+    return packKey(rpos);
+}
+
+uint64_t BiomeMap::hash(int x, int z, uint64_t salt) const
+{
+    return mix(((uint64_t)m_seed << 32) ^ mix(packKey(glm::ivec2(x, z)) ^ salt));
+}
+
+glm::dvec2 BiomeMap::cellPoint(const glm::ivec2 &cell) const
+{
+    // jittered within the middle 80% of the cell
+    const uint64_t h = hash(cell.x, cell.y, 0x63656c6cull);
+    const double jx = 0.1 + 0.8 * (h & 0xffff) / 65535.0;
+    const double jz = 0.1 + 0.8 * ((h >> 16) & 0xffff) / 65535.0;
+    return glm::dvec2((cell.x + jx) * BIOME_CELL, (cell.y + jz) * BIOME_CELL);
+}
+
+Biome BiomeMap::classify(const glm::dvec2 &p) const
+{
+    const double t = m_temperature.normalizedOctaveNoise2D<BIOME_CLIMATE_OCTAVES>(p.x / BIOME_CLIMATE_SCALE, p.y / BIOME_CLIMATE_SCALE);
+    const double h = m_humidity.normalizedOctaveNoise2D<BIOME_CLIMATE_OCTAVES>(p.x / BIOME_CLIMATE_SCALE, p.y / BIOME_CLIMATE_SCALE);
+
+    if(t < -0.12)
+        return (h < 0.0) ? BIOME_SCREE : BIOME_ROCKY;
+    if(t > 0.12 && h < -0.05)
+        return BIOME_BARREN;
+    return BIOME_PLAINS;
+}
+
+std::shared_ptr<BiomeMap::Region> BiomeMap::buildRegion(const glm::ivec2 &rpos) const
+{
+    // every cell whose point can be nearest to a block in the region, plus one ring
+    constexpr int CELLS = (BIOME_REGION >> BIOME_CELL_SHIFT) + 4;
+    const glm::ivec2 c0 = ((rpos * BIOME_REGION) >> BIOME_CELL_SHIFT) - 2;
+
+    glm::dvec2 points[CELLS][CELLS];
+    Biome cellBiome[CELLS][CELLS];
+    for(int i=0; i < CELLS; i++)
+    {
+        for(int j=0; j < CELLS; j++)
+        {
+            points[i][j] = cellPoint(c0 + glm::ivec2(i, j));
+            cellBiome[i][j] = classify(points[i][j]);
+        }
+    }
+
+    std::shared_ptr<Region> r = std::make_shared<Region>();
+    r->lastUse = 0;
+    for(int x=0; x < BIOME_REGION; x++)
+    {
+        for(int z=0; z < BIOME_REGION; z++)
+        {
+            const glm::ivec2 w = rpos * BIOME_REGION + glm::ivec2(x, z);
+            const glm::dvec2 p = glm::dvec2(w) + 0.5;
+            const glm::ivec2 home = (w >> BIOME_CELL_SHIFT) - c0;
+
+            // nearest and second nearest point in the 5x5 cells around
+            double d1 = 1e300, d2 = 1e300;
+            glm::ivec2 n1(0), n2(0);
+            for(int i = home.x-2; i <= home.x+2; i++)
+            {
+                for(int j = home.y-2; j <= home.y+2; j++)
+                {
+                    const glm::dvec2 d = points[i][j] - p;
+                    const double dd = d.x*d.x + d.y*d.y;
+                    if(dd < d1)
+                    {
+                        d2 = d1; n2 = n1;
+                        d1 = dd; n1 = glm::ivec2(i, j);
+                    }
+                    else if(dd < d2)
+                    {
+                        d2 = dd; n2 = glm::ivec2(i, j);
+                    }
+                }
+            }
+
+            Biome b = cellBiome[n1.x][n1.y];
+            const Biome other = cellBiome[n2.x][n2.y];
+            if(other != b)
+            {
+                // distance to the cell edge, dithered towards the other side near it
+                const glm::dvec2 e = points[n2.x][n2.y] - points[n1.x][n1.y];
+                const double edge = (d2 - d1) / (2.0 * std::sqrt(e.x*e.x + e.y*e.y));
+                if(edge < BIOME_BLEND)
+                {
+                    const double chance = 0.5 * (1.0 - edge / BIOME_BLEND);
+                    if((hash(w.x, w.y, 0x626c656eull) & 0xffff) < chance * 65536.0)
+                        b = other;
+                }
+            }
+            r->biomes[z + x*BIOME_REGION] = b;
+        }
+    }
+    return r;
+}
+
+std::shared_ptr<const BiomeMap::Region> BiomeMap::region(const glm::ivec2 &rpos)
+{
+    const uint64_t key = regionKey(rpos);
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        auto it = m_regions.find(key);
+        if(it != m_regions.end())
+        {
+            it->second->lastUse = ++m_useCounter;
+            return it->second;
+        }
+    }
+
+    // built unlocked, a racing builder's region wins and ours is dropped
+    std::shared_ptr<Region> r = buildRegion(rpos);
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    if(m_regions.size() >= BIOME_CACHE_REGIONS)
+    {
+        auto lru = std::min_element(m_regions.begin(), m_regions.end(),
+                                    [](const auto &a, const auto &b) { return a.second->lastUse < b.second->lastUse; });
+        m_regions.erase(lru);
+    }
+    auto res = m_regions.emplace(key, r);
+    res.first->second->lastUse = ++m_useCounter;
+    return res.first->second;
+}
+
+Biome BiomeMap::biomeAt(int x, int z)
+{
+    std::shared_ptr<const Region> r = region(glm::ivec2(x >> BIOME_REGION_SHIFT, z >> BIOME_REGION_SHIFT));
+    return (Biome)r->biomes[(z & (BIOME_REGION-1)) + (x & (BIOME_REGION-1))*BIOME_REGION];
+}
+
+void BiomeMap::biomes(const glm::ivec2 &column, int width, int depth, uint8_t *out)
+{
+    std::shared_ptr<const Region> r;
+    glm::ivec2 rpos;
+    for(int i=0; i < width; i++)
+    {
+        for(int j=0; j < depth; j++)
+        {
+            const int x = column.x*width + i, z = column.y*depth + j;
+            const glm::ivec2 p(x >> BIOME_REGION_SHIFT, z >> BIOME_REGION_SHIFT);
+            if(r == nullptr || p != rpos)
+            {
+                r = region(p);
+                rpos = p;
+            }
+            out[j + i*depth] = r->biomes[(z & (BIOME_REGION-1)) + (x & (BIOME_REGION-1))*BIOME_REGION];
+        }
+    }
+}
+
+std::shared_ptr<BiomeMap> BiomeMap::shared(uint32_t seed)
+{
+    static std::mutex lock;
+    static std::shared_ptr<BiomeMap> current;
+
+    std::lock_guard<std::mutex> lk(lock);
+    if(current == nullptr || current->seed() != seed)
+        current = std::make_shared<BiomeMap>(seed);
+    return current;
+}
@@ -0,0 +1,85 @@
+#ifndef BIOME_HPP
+#define BIOME_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "PerlinNoise.hpp"
+
+// climate noise: temperature and humidity at (x, z) / BIOME_CLIMATE_SCALE
+#define BIOME_CLIMATE_SCALE (512.0)
+#define BIOME_CLIMATE_OCTAVES (3)
+
+#define BIOME_CELL_SHIFT (5)      // Voronoi cells are 32x32 blocks, one climate sample each
+#define BIOME_CELL (1 << BIOME_CELL_SHIFT)
+#define BIOME_BLEND (6)           // border width in blocks where neighboring biomes are dithered
+#define BIOME_REGION_SHIFT (6)    // cached regions are 64x64 blocks
+#define BIOME_REGION (1 << BIOME_REGION_SHIFT)
+#define BIOME_CACHE_REGIONS (256)
+
+enum Biome : uint8_t
+{
+    BIOME_PLAINS,   // grass over dirt
+    BIOME_BARREN,   // bare dirt
+    BIOME_ROCKY,    // exposed stone
+    BIOME_SCREE,    // loose cobblestone over stone
+    BIOME_COUNT
+};
+
+// blocks a biome builds its columns from
+struct BiomeBlocks
+{
+    const char *name;
+    uint16_t top;      // surface block
+    uint16_t filler;   // below the surface down to the stone
+    uint8_t fillerFrom; // filler starts at surface*fillerFrom/8, stone below
+};
+
+// Biome per block column from a Voronoi diagram over jittered cell points,
+// each cell takes the biome of the climate noise at its point. Lookups are
+// cached per region as one byte per column, so asking for a biome never
+// touches the terrain noise or the generator.
+class BiomeMap
+{
+public:
+    explicit BiomeMap(uint32_t seed);
+
+    Biome biomeAt(int x, int z);
+    // biomes for a chunk column, out[j + i*depth]
+    void biomes(const glm::ivec2 &column, int width, int depth, uint8_t *out);
+
+    uint32_t seed() const;
+
+    static const BiomeBlocks &blocks(int biome);
+    static const char *name(int biome);
+
+    // map for the current world seed, replaced when the seed changes
+    static std::shared_ptr<BiomeMap> shared(uint32_t seed);
+private:
+    struct Region
+    {
+        uint8_t biomes[BIOME_REGION * BIOME_REGION]; // [z + x*BIOME_REGION]
+        uint64_t lastUse;
+    };
+
+    std::shared_ptr<const Region> region(const glm::ivec2 &rpos);
+    std::shared_ptr<Region> buildRegion(const glm::ivec2 &rpos) const;
+
+    glm::dvec2 cellPoint(const glm::ivec2 &cell) const;
+    Biome classify(const glm::dvec2 &p) const;
+    uint64_t hash(int x, int z, uint64_t salt) const;
+
+    static uint64_t regionKey(const glm::ivec2 &rpos);
+
+    siv::PerlinNoise m_temperature, m_humidity;
+    uint32_t m_seed;
+
+    std::mutex m_lock;
+    std::unordered_map<uint64_t, std::shared_ptr<Region>> m_regions;
+    uint64_t m_useCounter;
+};
+
+#endif // BIOME_HPP
@@ -1,111 +1,264 @@
 #include "chunk.hpp"
-#include "gamewindow.hpp"
+#include "chunkpool.hpp"
+#include "biome.hpp"
 
-#include "PerlinNoise.hpp"
+#include <algorithm>
 
-std::mutex *Chunk::chunkMutex = nullptr;
-
-__attribute__((constructor)) void chunk_init()
+template<int W, int H, int D>
+BasicChunk<W, H, D> *BasicChunk<W, H, D>::createChunk(const glm::ivec3 &pos, const int *heightmap, const uint8_t *biomes)
 {
-    Chunk::chunkMutex = new std::mutex();
-}
-
-__attribute__((destructor)) void chunk_deinit()
-{
-    delete Chunk::chunkMutex;
-}
-
-Chunk *Chunk::createChunk(const glm::ivec3 &pos, int *heightmap)
-{
-    Chunk *res = new Chunk();
-    res->pos = pos;
-    res->cdata.resize(CHUNK_WIDTH*CHUNK_HEIGHT*CHUNK_DEPTH, 0);
+    const int baseY = pos.y * H;
+    const int maxY = *std::max_element(heightmap, heightmap + W*D);
+    if(baseY >= maxY) // stays uniform air
+    {
+        BasicChunk *res = ChunkPool::instance().acquire();
+        res->pos = pos;
+        return res;
+    }
 
-    for(int i=0; i < CHUNK_WIDTH; i++)
+    uint16_t blocks[VOLUME] = {0};
+    for(int i=0; i < W; i++)
     {
-        for(int j=0; j < CHUNK_DEPTH; j++)
+        for(int j=0; j < D; j++)
         {
-            const int py = heightmap[j + i*4];
+            const int py = heightmap[j + i*D];
+            const int top = std::min(py, baseY + H);
+            const BiomeBlocks &bb = BiomeMap::blocks(biomes ? (int)biomes[j + i*D] : (int)BIOME_PLAINS);
+            const int fillerFrom = py * bb.fillerFrom / 8;
 
-            for(int h=pos.y; h < py; h++)
+            for(int h=baseY; h < top; h++)
             {
                 int bid;
                 if(h < 2)
                     bid = 7;
-                else if(h < (py / 2))
+                else if(h < fillerFrom)
                     bid = 1;
-                else if(h < (py-1))
-                    bid = 3;
+                else
+                    bid = bb.filler;
 
                 if(h == py-1)
-                    bid = 2;
+                    bid = bb.top;
 
-                int k = h - pos.y;
-                res->setBlock(glm::ivec3(i, k, j), bid);
+                blocks[index(i, h - baseY, j)] = bid;
             }
         }
     }
-    return res;
+    return fromBlocks(pos, blocks);
 }
 
-void Chunk::generateChunk(glm::ivec2 pos, std::unordered_map<std::string, Chunk*> &outPtr)
+template<int W, int H, int D>
+BasicChunk<W, H, D> *BasicChunk<W, H, D>::fromBlocks(const glm::ivec3 &pos, const uint16_t *blocks)
 {
-    std::vector<Chunk*> buffer;
-
-    int hmap[CHUNK_WIDTH * CHUNK_DEPTH];
-    siv::PerlinNoise noiseGen(GameWindow::m_seed);
-    for(int i=0; i < CHUNK_WIDTH; i++)
-        for(int j=0; j < CHUNK_DEPTH; j++)
-            hmap[j + i*4] = 1 + (63) * (noiseGen.accumulatedOctaveNoise2D((4*pos.x + i)/128.0, (4*pos.y + j)/128.0, 16) + 1.0) / 2.0;
+    BasicChunk *res = ChunkPool::instance().acquire();
+    res->pos = pos;
+    res->cdata.load(blocks);
+    for(int i=0; i < VOLUME; i++)
+    {
+        if(blocks[i] != 0)
+            res->occupied.set(i);
+    }
+    return res;
+}
 
-    for(int i=0; i < 16; i++)
-        buffer.push_back(Chunk::createChunk(glm::ivec3(pos.x, i, pos.y), hmap));
+template<int W, int H, int D>
+BasicChunk<W, H, D> *BasicChunk<W, H, D>::clone(const BasicChunk *src)
+{
+    BasicChunk *res = ChunkPool::instance().acquire();
+    res->pos = src->pos;
+    res->cdata = src->cdata;
+    res->occupied = src->occupied;
+    res->lastAccess = src->lastAccess;
+    res->version = src->version;
+    res->savedVersion = src->savedVersion;
+    res->dirty = src->dirty;
+    std::copy(src->regionVersion, src->regionVersion + DIRTY_REGIONS, res->regionVersion);
+    return res;
+}
 
-    Chunk::chunkMutex->lock();
-    for(int i=0; i < 16; i++)
-        outPtr[asString(glm::ivec3(pos.x, i, pos.y))] = buffer[i];
-    Chunk::chunkMutex->unlock();
+template<int W, int H, int D>
+BasicChunk<W, H, D> *BasicChunk<W, H, D>::fromPalette(const glm::ivec3 &pos, int bits, int count, int live,
+                                                     const uint16_t *palette, const uint64_t *words,
+                                                     std::shared_ptr<const void> backing)
+{
+    BasicChunk *res = ChunkPool::instance().acquire();
+    if(!res->cdata.borrow(bits, count, live, palette, words, std::move(backing)))
+    {
+        ChunkPool::instance().release(res);
+        return nullptr;
+    }
+    res->pos = pos;
+    if(res->cdata.isUniform())
+    {
+        if(res->cdata.get(0) != 0)
+            res->occupied.set();
+        return res;
+    }
+    for(int i=0; i < VOLUME; i++)
+    {
+        if(res->cdata.get(i) != 0)
+            res->occupied.set(i);
+    }
+    return res;
 }
 
-bool Chunk::setBlock(const glm::ivec3 &rpos, int id)
+template<int W, int H, int D>
+bool BasicChunk<W, H, D>::setBlock(const glm::ivec3 &rpos, int id)
 {
-    if(rpos.x < 0 || rpos.y < 0 || rpos.z < 0)
-        return false;
-    if(abs(rpos.x) >= CHUNK_WIDTH || abs(rpos.y) >= CHUNK_HEIGHT || abs(rpos.z) >= CHUNK_DEPTH)
+    if(!inBounds(rpos))
         return false;
 
-    int bpos = rpos.x*CHUNK_DEPTH*CHUNK_HEIGHT + rpos.y*CHUNK_DEPTH + rpos.z;
-    cdata[bpos] = id;
+    setBlockAt(index(rpos.x, rpos.y, rpos.z), id);
     return true;
 }
 
-int Chunk::getBlock(const glm::ivec3 &rpos)
+template<int W, int H, int D>
+int BasicChunk<W, H, D>::getBlock(const glm::ivec3 &rpos)
 {
-    if(rpos.x < 0 || rpos.y < 0 || rpos.z < 0)
-        return 0;
-    if(abs(rpos.x) >= CHUNK_WIDTH || abs(rpos.y) >= CHUNK_HEIGHT || abs(rpos.z) >= CHUNK_DEPTH)
+    if(!inBounds(rpos))
         return 0;
 
-    int bpos = rpos.x*CHUNK_DEPTH*CHUNK_HEIGHT + rpos.y*CHUNK_DEPTH + rpos.z;
-    return cdata[bpos];
+    return getBlockAt(index(rpos.x, rpos.y, rpos.z));
 }
 
-void Chunk::update(uint64_t curTick)
+template<int W, int H, int D>
+void BasicChunk<W, H, D>::update(uint64_t curTick)
 {
     (void)curTick;
 }
 
-const std::set<int> &Chunk::getTextures() const
+template<int W, int H, int D>
+uint64_t BasicChunk<W, H, D>::changedSince(uint32_t since) const
 {
-    return textures;
+    if(version <= since)
+        return 0;
+
+    uint64_t mask = 0;
+    for(int r=0; r < DIRTY_REGIONS; r++)
+    {
+        if(regionVersion[r] > since)
+            mask |= 1ull << r;
+    }
+    return mask;
 }
 
-const glm::ivec3 &Chunk::getPos() const
+template<int W, int H, int D>
+bool BasicChunk<W, H, D>::dirtyBounds(uint64_t mask, glm::ivec3 &min, glm::ivec3 &max)
+{
+    if(mask == 0)
+        return false;
+
+    const glm::ivec3 rsize(W >> DIRTY_SHIFT_X, H >> DIRTY_SHIFT_Y, D >> DIRTY_SHIFT_Z);
+    min = glm::ivec3(W, H, D);
+    max = glm::ivec3(0);
+    for(int r=0; r < DIRTY_REGIONS; r++)
+    {
+        if(!(mask & (1ull << r)))
+            continue;
+        const glm::ivec3 rpos(r >> (DIRTY_SHIFT_Y + DIRTY_SHIFT_Z),
+                              (r >> DIRTY_SHIFT_Z) & ((1 << DIRTY_SHIFT_Y) - 1),
+                              r & ((1 << DIRTY_SHIFT_Z) - 1));
+        min = glm::min(min, rpos * rsize);
+        max = glm::max(max, (rpos + 1) * rsize);
+    }
+    return true;
+}
+
+namespace
+{
+    // first/last y and z slices of a chunk mask, x slices need no masking
+    // since shifting by a whole slice drops off the end
+    template<int W, int H, int D>
+    struct MaskLayers
+    {
+        typedef std::bitset<W*H*D> Mask;
+        Mask yFirst, yLast, zFirst, zLast;
+
+        MaskLayers()
+        {
+            for(int x=0; x < W; x++)
+            {
+                for(int y=0; y < H; y++)
+                {
+                    for(int z=0; z < D; z++)
+                    {
+                        const int i = BasicChunk<W, H, D>::index(x, y, z);
+                        yFirst[i] = (y == 0);
+                        yLast[i]  = (y == H-1);
+                        zFirst[i] = (z == 0);
+                        zLast[i]  = (z == D-1);
+                    }
+                }
+            }
+        }
+
+        static const MaskLayers &get()
+        {
+            static const MaskLayers layers;
+            return layers;
+        }
+    };
+}
+
+template<int W, int H, int D>
+const typename BasicChunk<W, H, D>::Mask &BasicChunk<W, H, D>::fullMask()
+{
+    static const Mask full = Mask().set();
+    return full;
+}
+
+template<int W, int H, int D>
+typename BasicChunk<W, H, D>::Mask BasicChunk<W, H, D>::exposed(const Mask *const neighbors[FACE_COUNT]) const
+{
+    const MaskLayers<W, H, D> &L = MaskLayers<W, H, D>::get();
+    constexpr int SX = H*D, SY = D;
+    const Mask none;
+    const Mask &px = neighbors[POS_X] ? *neighbors[POS_X] : none;
+    const Mask &nx = neighbors[NEG_X] ? *neighbors[NEG_X] : none;
+    const Mask &py = neighbors[POS_Y] ? *neighbors[POS_Y] : none;
+    const Mask &ny = neighbors[NEG_Y] ? *neighbors[NEG_Y] : none;
+    const Mask &pz = neighbors[POS_Z] ? *neighbors[POS_Z] : none;
+    const Mask &nz = neighbors[NEG_Z] ? *neighbors[NEG_Z] : none;
+
+    // bit i of each term: the block next to i in that direction is solid,
+    // the neighbor's facing layer is shifted into our boundary layer
+    Mask covered = (occupied >> SX) | (px << SX*(W-1));
+    covered &= (occupied << SX) | (nx >> SX*(W-1));
+    covered &= ((occupied >> SY) & ~L.yLast) | ((py << SY*(H-1)) & L.yLast);
+    covered &= ((occupied << SY) & ~L.yFirst) | ((ny >> SY*(H-1)) & L.yFirst);
+    covered &= ((occupied >> 1) & ~L.zLast) | ((pz << (D-1)) & L.zLast);
+    covered &= ((occupied << 1) & ~L.zFirst) | ((nz >> (D-1)) & L.zFirst);
+    return occupied & ~covered;
+}
+
+template<int W, int H, int D>
+const glm::ivec3 &BasicChunk<W, H, D>::getPos() const
 {
     return pos;
 }
 
-const uint8_t *Chunk::data() const
+template<int W, int H, int D>
+uint64_t BasicChunk<W, H, D>::contentHash() const
 {
-    return cdata.data();
+    uint64_t h = 1469598103934665603ull;
+    for(int i=0; i < VOLUME; i++)
+    {
+        const uint16_t id = cdata.get(i);
+        h = (h ^ (id & 0xff)) * 1099511628211ull;
+        h = (h ^ (id >> 8)) * 1099511628211ull;
+    }
+    return h;
+}
+
+template<int W, int H, int D>
+int BasicChunk<W, H, D>::paletteSize() const
+{
+    return cdata.paletteSize();
 }
+
+template<int W, int H, int D>
+size_t BasicChunk<W, H, D>::memoryUsage() const
+{
+    return sizeof(BasicChunk) - sizeof(cdata) + cdata.memoryUsage();
+}
+
+template class BasicChunk<CHUNK_WIDTH, CHUNK_HEIGHT, CHUNK_DEPTH>;
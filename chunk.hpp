@@ -2,41 +2,202 @@
 #define CHUNK_HPP
 
 #include <glm/glm.hpp>
-#include <set>
-#include <vector>
-#include <unordered_map>
-#include <mutex>
+#include <atomic>
+#include <bitset>
 
+#include "palette.hpp"
+
+// chunk dimensions are picked at build time, e.g. -DCHUNK_WIDTH=16
+#ifndef CHUNK_WIDTH
 #define CHUNK_WIDTH (4)
+#endif
+#ifndef CHUNK_HEIGHT
 #define CHUNK_HEIGHT (4)
+#endif
+#ifndef CHUNK_DEPTH
 #define CHUNK_DEPTH (4)
+#endif
+
+// world height in blocks
+#define WORLD_HEIGHT (64)
 
-class Chunk
+// records are cache-line aligned, see ChunkPool
+template<int W, int H, int D>
+class alignas(64) BasicChunk
 {
+    static constexpr int ilog2(int v) { return (v > 1) ? 1 + ilog2(v >> 1) : 0; }
+
+    static_assert(W > 0 && (W & (W-1)) == 0, "chunk width must be a power of two");
+    static_assert(H > 0 && (H & (H-1)) == 0, "chunk height must be a power of two");
+    static_assert(D > 0 && (D & (D-1)) == 0, "chunk depth must be a power of two");
+    static_assert(WORLD_HEIGHT % H == 0, "world height must be a multiple of chunk height");
 public:
+    static constexpr int WIDTH  = W;
+    static constexpr int HEIGHT = H;
+    static constexpr int DEPTH  = D;
+    static constexpr int VOLUME = W*H*D;
+    static constexpr int COLUMN_HEIGHT = WORLD_HEIGHT / H; // chunks per column
+
+    static constexpr int SHIFT_X = ilog2(W);
+    static constexpr int SHIFT_Y = ilog2(H);
+    static constexpr int SHIFT_Z = ilog2(D);
+
+    // block index, layout is x*D*H + y*D + z
+    static constexpr int index(int x, int y, int z)
+    {
+        return (x << (SHIFT_Y + SHIFT_Z)) | (y << SHIFT_Z) | z;
+    }
+
+    static constexpr bool inBounds(const glm::ivec3 &rpos)
+    {
+        return ((unsigned)rpos.x < (unsigned)W) &&
+               ((unsigned)rpos.y < (unsigned)H) &&
+               ((unsigned)rpos.z < (unsigned)D);
+    }
+
+    // world block position -> chunk position (floored for negatives)
+    static glm::ivec3 toChunkPos(const glm::ivec3 &wpos)
+    {
+        return glm::ivec3(wpos.x >> SHIFT_X, wpos.y >> SHIFT_Y, wpos.z >> SHIFT_Z);
+    }
+
+    // world block position -> position inside its chunk
+    static glm::ivec3 toLocalPos(const glm::ivec3 &wpos)
+    {
+        return glm::ivec3(wpos.x & (W-1), wpos.y & (H-1), wpos.z & (D-1));
+    }
+
+    static glm::ivec3 size()
+    {
+        return glm::ivec3(W, H, D);
+    }
+
+    // change tracking splits the chunk into up to 4x4x4 sub-regions, one mask bit each
+    static constexpr int DIRTY_SHIFT_X = (SHIFT_X < 2) ? SHIFT_X : 2;
+    static constexpr int DIRTY_SHIFT_Y = (SHIFT_Y < 2) ? SHIFT_Y : 2;
+    static constexpr int DIRTY_SHIFT_Z = (SHIFT_Z < 2) ? SHIFT_Z : 2;
+    static constexpr int DIRTY_REGIONS = 1 << (DIRTY_SHIFT_X + DIRTY_SHIFT_Y + DIRTY_SHIFT_Z);
+
+    static constexpr int dirtyRegion(int idx)
+    {
+        const int x = idx >> (SHIFT_Y + SHIFT_Z);
+        const int y = (idx >> SHIFT_Z) & (H-1);
+        const int z = idx & (D-1);
+        return ((x >> (SHIFT_X - DIRTY_SHIFT_X)) << (DIRTY_SHIFT_Y + DIRTY_SHIFT_Z)) |
+               ((y >> (SHIFT_Y - DIRTY_SHIFT_Y)) << DIRTY_SHIFT_Z) |
+                (z >> (SHIFT_Z - DIRTY_SHIFT_Z));
+    }
+
+    // block-space box [min, max) covering every sub-region in mask, false if mask is empty
+    static bool dirtyBounds(uint64_t mask, glm::ivec3 &min, glm::ivec3 &max);
+
+    // one bit per block index, set where the block isn't air
+    typedef std::bitset<VOLUME> Mask;
+
+    enum Face { POS_X, NEG_X, POS_Y, NEG_Y, POS_Z, NEG_Z, FACE_COUNT };
+
+    static glm::ivec3 faceNormal(int face)
+    {
+        const int s = (face & 1) ? -1 : 1;
+        return glm::ivec3(face < 2 ? s : 0, (face >> 1) == 1 ? s : 0, face >= 4 ? s : 0);
+    }
+
+    // every block solid, stands in for whatever lies below the world
+    static const Mask &fullMask();
+
+    BasicChunk() : pos(0), lastAccess(0), version(0), savedVersion(0), dirty(0), regionVersion{}, snapshot(SNAPSHOT_NONE) {}
+
     bool setBlock(const glm::ivec3 &rpos, int id);
     int getBlock(const glm::ivec3 &rpos);
 
+    // unchecked fast path, idx comes from index()
+    inline void setBlockAt(int idx, int id)
+    {
+        if(!cdata.set(idx, id))
+            return;
+        occupied.set(idx, id != 0);
+        const int r = dirtyRegion(idx);
+        regionVersion[r] = ++version;
+        dirty |= 1ull << r;
+    }
+    inline int getBlockAt(int idx) const { return cdata.get(idx); }
+
+    inline const Mask &occupancy() const { return occupied; }
+    // solid blocks with at least one face open to air, neighbors are occupancy
+    // masks indexed by Face, nullptr is treated as air
+    Mask exposed(const Mask *const neighbors[FACE_COUNT]) const;
+
     // TODO: Chunk::update()
     void update(uint64_t curTick);
 
-    const std::set<int> &getTextures() const;
-
     const glm::ivec3 &getPos() const;
 
-    const uint8_t *data() const;
+    // residency bookkeeping, see ChunkResidency
+    inline void touch(uint64_t tick) { lastAccess = tick; }
+    inline uint64_t lastAccessTick() const { return lastAccess; }
+    // bumped by every block change, 0 for a freshly generated chunk
+    inline uint32_t getVersion() const { return version; }
+    // sub-regions changed after version `since`
+    uint64_t changedSince(uint32_t since) const;
 
-    // heightmap is 4x4 elements array
-    static Chunk *createChunk(const glm::ivec3 &pos, int *heightmap);
-    static void generateChunk(glm::ivec2 pos, std::unordered_map<std::string, Chunk*> &outPtr);
+    // edited since generation/last save
+    inline bool isModified() const { return version != savedVersion; }
+    inline uint64_t dirtyMask() const { return dirty; }
+    inline void markSaved() { savedVersion = version; dirty = 0; }
+    // saved as of version `at`, later changes stay dirty
+    inline void markSaved(uint32_t at) { savedVersion = at; dirty = changedSince(at); }
 
-    static std::mutex *chunkMutex;
+    // snapshot handshake, see WorldSaver: a held chunk is being written and
+    // must not change, an edit detaches it (the store gets a clone) and the
+    // saver retires it; exactly one side wins each transition
+    enum SnapshotState : uint8_t { SNAPSHOT_NONE, SNAPSHOT_HELD, SNAPSHOT_DETACHED };
+    inline SnapshotState snapshotState() const { return (SnapshotState)snapshot.load(std::memory_order_acquire); }
+    inline bool hold() { return transition(SNAPSHOT_NONE, SNAPSHOT_HELD); }
+    // false if the saver already let go, the chunk can be changed in place then
+    inline bool detach() { return transition(SNAPSHOT_HELD, SNAPSHOT_DETACHED); }
+    // false if the chunk was detached, the caller owns it then
+    inline bool unhold() { return transition(SNAPSHOT_HELD, SNAPSHOT_NONE); }
+
+    // whole chunk is a single block id, stored without an index array
+    inline bool isUniform() const { return cdata.isUniform(); }
+    inline int uniformBlock() const { return cdata.get(0); }
+    // blocks still read from a mapped file, copied on the first change
+    inline bool isBorrowed() const { return cdata.isBorrowed(); }
+    inline const PalettedStorage<VOLUME> &storage() const { return cdata; }
+
+    // FNV-1a over the block ids in index() order, independent of the storage layout
+    uint64_t contentHash() const;
+
+    // distinct block ids in this chunk
+    int paletteSize() const;
+    size_t memoryUsage() const;
+
+    // heightmap and biomes are WIDTH x DEPTH elements arrays, no biomes means plains
+    static BasicChunk *createChunk(const glm::ivec3 &pos, const int *heightmap, const uint8_t *biomes = nullptr);
+    // blocks are VOLUME ids in index() order
+    static BasicChunk *fromBlocks(const glm::ivec3 &pos, const uint16_t *blocks);
+    // borrows a palette layout in place, see PalettedStorage::borrow; nullptr if it's invalid
+    static BasicChunk *fromPalette(const glm::ivec3 &pos, int bits, int count, int live, const uint16_t *palette,
+                                   const uint64_t *words, std::shared_ptr<const void> backing);
+    // copy from the pool with the blocks and change tracking, not held
+    static BasicChunk *clone(const BasicChunk *src);
 private:
+    inline bool transition(uint8_t from, uint8_t to)
+    {
+        return snapshot.compare_exchange_strong(from, to, std::memory_order_acq_rel);
+    }
+
     glm::ivec3 pos;        // pos in chunks
-    std::vector<uint8_t> cdata;
-//    uint8_t cdata[CHUNK_WIDTH*CHUNK_HEIGHT*CHUNK_DEPTH];
-    std::set<int> textures;
-//    uint8_t textures[16];
+    PalettedStorage<VOLUME> cdata;
+    Mask occupied;
+    uint64_t lastAccess;   // tick
+
+    uint32_t version, savedVersion;
+    uint64_t dirty;        // sub-regions changed since last save
+    uint32_t regionVersion[DIRTY_REGIONS]; // version of the last change per sub-region
+    std::atomic<uint8_t> snapshot;
 };
 
+typedef BasicChunk<CHUNK_WIDTH, CHUNK_HEIGHT, CHUNK_DEPTH> Chunk;
+
 #endif // CHUNK_HPP
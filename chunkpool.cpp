@@ -0,0 +1,102 @@
+#include "chunkpool.hpp"
+#include "epoch.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+
+ChunkPool::ChunkPool()
+    : m_free(nullptr), m_stats{0, 0, 0, 0, 0}
+{
+    // retired chunks come back here, so the epoch manager is built first and destroyed last
+    EpochManager::global();
+}
+
+ChunkPool::~ChunkPool()
+{
+    // what was retired last, no reader is left at exit
+    EpochManager::global().reclaim();
+
+    // records still in use own heap palettes and mapping references, free ones are on the list
+    std::vector<const void*> free;
+    for(FreeNode *n = m_free; n != nullptr; n = n->next)
+        free.push_back(n);
+    std::sort(free.begin(), free.end());
+
+    size_t live = 0;
+    for(void *slab : m_slabs)
+    {
+        for(int i=0; i < CHUNKS_PER_SLAB; i++)
+        {
+            Chunk *ch = (Chunk*)((char*)slab + i*sizeof(Chunk));
+            if(!std::binary_search(free.begin(), free.end(), (const void*)ch))
+            {
+                ch->~Chunk();
+                live++;
+            }
+        }
+        ::operator delete(slab, std::align_val_t(alignof(Chunk)));
+    }
+    if(live > 0)
+        fprintf(stderr, "[pool] %zu chunks still in use at exit\n", live);
+}
+
+ChunkPool &ChunkPool::instance()
+{
+    static ChunkPool pool;
+    return pool;
+}
+
+void ChunkPool::grow()
+{
+    char *slab = (char*)::operator new(CHUNKS_PER_SLAB * sizeof(Chunk), std::align_val_t(alignof(Chunk)));
+    m_slabs.push_back(slab);
+
+    // thread the new records onto the free list, lowest address first
+    for(int i=CHUNKS_PER_SLAB-1; i >= 0; i--)
+    {
+        FreeNode *node = (FreeNode*)(slab + i*sizeof(Chunk));
+        node->next = m_free;
+        m_free = node;
+    }
+
+    m_stats.slabs++;
+    m_stats.capacity += CHUNKS_PER_SLAB;
+}
+
+Chunk *ChunkPool::acquire()
+{
+    void *mem;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stats.acquired++;
+        if(m_free == nullptr)
+            grow();
+
+        mem = m_free;
+        m_free = m_free->next;
+        m_stats.inUse++;
+    }
+    return new (mem) Chunk();
+}
+
+void ChunkPool::release(Chunk *ch)
+{
+    if(ch == nullptr)
+        return;
+
+    ch->~Chunk();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    FreeNode *node = (FreeNode*)ch;
+    node->next = m_free;
+    m_free = node;
+    m_stats.inUse--;
+    m_stats.released++;
+}
+
+ChunkPool::Stats ChunkPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
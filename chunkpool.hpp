@@ -0,0 +1,49 @@
+#ifndef CHUNKPOOL_HPP
+#define CHUNKPOOL_HPP
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+#include "chunk.hpp"
+
+#define CHUNKS_PER_SLAB (256)
+
+// Slab allocator for chunk records; released chunks go on a free list and get reused
+class ChunkPool
+{
+public:
+    struct Stats
+    {
+        size_t slabs;     // slabs allocated
+        size_t capacity;  // records in all slabs
+        size_t inUse;
+        size_t acquired;  // total acquire() calls
+        size_t released;  // total release() calls
+    };
+
+    ChunkPool();
+    ~ChunkPool();
+
+    // returns a fresh uniform-air chunk
+    Chunk *acquire();
+    void release(Chunk *ch);
+
+    Stats stats() const;
+
+    static ChunkPool &instance();
+private:
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    void grow();
+
+    mutable std::mutex m_lock;
+    std::vector<void*> m_slabs;
+    FreeNode *m_free;
+    Stats m_stats;
+};
+
+#endif // CHUNKPOOL_HPP
@@ -0,0 +1,244 @@
+#include "chunkstore.hpp"
+#include "chunkpool.hpp"
+
+#define DIRECTORY_CAPACITY (64)
+
+ChunkStore::ChunkStore()
+    : m_dir(createDirectory(DIRECTORY_CAPACITY)), m_size(0)
+{
+
+}
+
+ChunkStore::~ChunkStore()
+{
+    clear();
+    destroyDirectory(m_dir.load());
+}
+
+// 21 bits per axis, arithmetic shift keeps negative coords floored
+uint64_t ChunkStore::packKey(const glm::ivec3 &rpos)
+{
+    const uint64_t mask = (1ull << 21) - 1;
+    return ((uint64_t)(rpos.x & mask) << 42) |
+           ((uint64_t)(rpos.y & mask) << 21) |
+            (uint64_t)(rpos.z & mask);
+}
+
+int ChunkStore::slotIndex(const glm::ivec3 &cpos)
+{
+    const int mask = REGION_SIZE - 1;
+    return ((cpos.x & mask) << (2*REGION_SHIFT)) |
+           ((cpos.y & mask) << REGION_SHIFT) |
+            (cpos.z & mask);
+}
+
+size_t ChunkStore::hashKey(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key;
+}
+
+ChunkStore::Region *ChunkStore::tombstone()
+{
+    return (Region*)(uintptr_t)1;
+}
+
+ChunkStore::Directory *ChunkStore::createDirectory(size_t capacity)
+{
+    Directory *dir = new Directory;
+    dir->capacity = capacity;
+    dir->used = 0;
+    dir->slots = new std::atomic<Region*>[capacity];
+    for(size_t i=0; i < capacity; i++)
+        dir->slots[i].store(nullptr, std::memory_order_relaxed);
+    return dir;
+}
+
+void ChunkStore::destroyDirectory(void *dir)
+{
+    Directory *d = (Directory*)dir;
+    delete[] d->slots;
+    delete d;
+}
+
+void ChunkStore::destroyRegion(void *reg)
+{
+    delete (Region*)reg;
+}
+
+void ChunkStore::retire(Chunk *ch)
+{
+    EpochManager::global().retire(ch, [](void *p) { ChunkPool::instance().release((Chunk*)p); });
+}
+
+ChunkStore::Region *ChunkStore::findRegion(const Directory *dir, uint64_t key) const
+{
+    const size_t mask = dir->capacity - 1;
+    for(size_t i = hashKey(key) & mask;; i = (i+1) & mask)
+    {
+        Region *reg = dir->slots[i].load(std::memory_order_acquire);
+        if(reg == nullptr)
+            return nullptr;
+        if(reg != tombstone() && reg->key == key)
+            return reg;
+    }
+}
+
+Chunk *ChunkStore::get(const glm::ivec3 &cpos) const
+{
+    const Directory *dir = m_dir.load(std::memory_order_acquire);
+    const Region *reg = findRegion(dir, packKey(cpos >> REGION_SHIFT));
+    if(reg == nullptr)
+        return nullptr;
+    return reg->chunks[slotIndex(cpos)].load(std::memory_order_acquire);
+}
+
+// writer lock held
+void ChunkStore::grow()
+{
+    Directory *old = m_dir.load(std::memory_order_relaxed);
+    size_t live = 0;
+    for(size_t i=0; i < old->capacity; i++)
+    {
+        Region *reg = old->slots[i].load(std::memory_order_relaxed);
+        if(reg != nullptr && reg != tombstone())
+            live++;
+    }
+
+    // only rehash in place when tombstones are the problem
+    const size_t capacity = (live*4 >= old->capacity) ? old->capacity*2 : old->capacity;
+    Directory *dir = createDirectory(capacity);
+    const size_t mask = capacity - 1;
+    for(size_t i=0; i < old->capacity; i++)
+    {
+        Region *reg = old->slots[i].load(std::memory_order_relaxed);
+        if(reg == nullptr || reg == tombstone())
+            continue;
+        size_t j = hashKey(reg->key) & mask;
+        while(dir->slots[j].load(std::memory_order_relaxed) != nullptr)
+            j = (j+1) & mask;
+        dir->slots[j].store(reg, std::memory_order_relaxed);
+        dir->used++;
+    }
+
+    m_dir.store(dir, std::memory_order_seq_cst);
+    EpochManager::global().retire(old, destroyDirectory);
+}
+
+// writer lock held
+ChunkStore::Region *ChunkStore::createRegion(uint64_t key)
+{
+    if((m_dir.load(std::memory_order_relaxed)->used + 1) * 2 > m_dir.load(std::memory_order_relaxed)->capacity)
+        grow();
+
+    Directory *dir = m_dir.load(std::memory_order_relaxed);
+    Region *reg = new Region;
+    reg->key = key;
+    reg->count = 0;
+    for(std::atomic<Chunk*> &slot : reg->chunks)
+        slot.store(nullptr, std::memory_order_relaxed);
+
+    const size_t mask = dir->capacity - 1;
+    for(size_t i = hashKey(key) & mask;; i = (i+1) & mask)
+    {
+        Region *cur = dir->slots[i].load(std::memory_order_relaxed);
+        if(cur == nullptr || cur == tombstone())
+        {
+            if(cur == nullptr)
+                dir->used++;
+            dir->slots[i].store(reg, std::memory_order_release);
+            return reg;
+        }
+    }
+}
+
+Chunk *ChunkStore::set(const glm::ivec3 &cpos, Chunk *ch)
+{
+    if(ch == nullptr)
+        return remove(cpos);
+
+    std::lock_guard<std::mutex> lock(m_writeLock);
+    const uint64_t key = packKey(cpos >> REGION_SHIFT);
+    Region *reg = findRegion(m_dir.load(std::memory_order_relaxed), key);
+    if(reg == nullptr)
+        reg = createRegion(key);
+
+    Chunk *prev = reg->chunks[slotIndex(cpos)].exchange(ch, std::memory_order_seq_cst);
+    if(prev == nullptr)
+    {
+        reg->count++;
+        m_size.fetch_add(1, std::memory_order_relaxed);
+    }
+    return prev;
+}
+
+bool ChunkStore::insert(const glm::ivec3 &cpos, Chunk *ch)
+{
+    std::lock_guard<std::mutex> lock(m_writeLock);
+    const uint64_t key = packKey(cpos >> REGION_SHIFT);
+    Region *reg = findRegion(m_dir.load(std::memory_order_relaxed), key);
+    if(reg == nullptr)
+        reg = createRegion(key);
+
+    std::atomic<Chunk*> &slot = reg->chunks[slotIndex(cpos)];
+    if(slot.load(std::memory_order_relaxed) != nullptr)
+        return false;
+
+    slot.store(ch, std::memory_order_seq_cst);
+    reg->count++;
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+Chunk *ChunkStore::remove(const glm::ivec3 &cpos)
+{
+    std::lock_guard<std::mutex> lock(m_writeLock);
+    Directory *dir = m_dir.load(std::memory_order_relaxed);
+    const uint64_t key = packKey(cpos >> REGION_SHIFT);
+    Region *reg = findRegion(dir, key);
+    if(reg == nullptr)
+        return nullptr;
+
+    Chunk *prev = reg->chunks[slotIndex(cpos)].exchange(nullptr, std::memory_order_seq_cst);
+    if(prev == nullptr)
+        return nullptr;
+
+    m_size.fetch_sub(1, std::memory_order_relaxed);
+    if(--reg->count == 0)
+    {
+        const size_t mask = dir->capacity - 1;
+        for(size_t i = hashKey(key) & mask;; i = (i+1) & mask)
+        {
+            if(dir->slots[i].load(std::memory_order_relaxed) == reg)
+            {
+                dir->slots[i].store(tombstone(), std::memory_order_seq_cst);
+                break;
+            }
+        }
+        EpochManager::global().retire(reg, destroyRegion);
+    }
+    return prev;
+}
+
+void ChunkStore::clear()
+{
+    std::lock_guard<std::mutex> lock(m_writeLock);
+    Directory *old = m_dir.load(std::memory_order_relaxed);
+    m_dir.store(createDirectory(DIRECTORY_CAPACITY), std::memory_order_seq_cst);
+    m_size.store(0, std::memory_order_relaxed);
+
+    for(size_t i=0; i < old->capacity; i++)
+    {
+        Region *reg = old->slots[i].load(std::memory_order_relaxed);
+        if(reg != nullptr && reg != tombstone())
+            EpochManager::global().retire(reg, destroyRegion);
+    }
+    EpochManager::global().retire(old, destroyDirectory);
+}
+
+size_t ChunkStore::size() const
+{
+    return m_size.load(std::memory_order_relaxed);
+}
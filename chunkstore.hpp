@@ -0,0 +1,94 @@
+#ifndef CHUNKSTORE_HPP
+#define CHUNKSTORE_HPP
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+#include "chunk.hpp"
+#include "epoch.hpp"
+
+// region is REGION_SIZE^3 chunks
+#define REGION_SHIFT (4)
+#define REGION_SIZE (1 << REGION_SHIFT)
+
+// Two-level chunk directory: packed region coordinates -> dense array of chunk pointers.
+// Readers never lock: get() and forEach() must run inside an EpochGuard.
+// Writers serialize on an internal mutex; chunks they unlink are handed back
+// to the caller, who retires them with retire() once nothing links to them.
+class ChunkStore
+{
+public:
+    ChunkStore();
+    ~ChunkStore();
+
+    Chunk *get(const glm::ivec3 &cpos) const;
+
+    // both return the chunk previously in the slot (nullptr if none)
+    Chunk *set(const glm::ivec3 &cpos, Chunk *ch);
+    Chunk *remove(const glm::ivec3 &cpos);
+    // publishes ch only into an empty slot, false if one is already there
+    bool insert(const glm::ivec3 &cpos, Chunk *ch);
+
+    // drops all entries, chunks are not retired
+    void clear();
+
+    size_t size() const;
+
+    // returns a chunk to the pool once readers are done with it
+    static void retire(Chunk *ch);
+
+    static uint64_t packKey(const glm::ivec3 &rpos);
+
+    template<typename F>
+    void forEach(F fn) const
+    {
+        const Directory *dir = m_dir.load(std::memory_order_acquire);
+        for(size_t i=0; i < dir->capacity; i++)
+        {
+            const Region *reg = dir->slots[i].load(std::memory_order_acquire);
+            if(reg == nullptr || reg == tombstone())
+                continue;
+            for(const std::atomic<Chunk*> &slot : reg->chunks)
+            {
+                Chunk *ch = slot.load(std::memory_order_acquire);
+                if(ch != nullptr)
+                    fn(ch);
+            }
+        }
+    }
+private:
+    struct Region
+    {
+        uint64_t key;
+        int count; // writer side only
+        std::atomic<Chunk*> chunks[REGION_SIZE*REGION_SIZE*REGION_SIZE];
+    };
+
+    // open addressing, capacity is a power of two
+    struct Directory
+    {
+        size_t capacity;
+        size_t used; // live + tombstones, writer side only
+        std::atomic<Region*> *slots;
+    };
+
+    static int slotIndex(const glm::ivec3 &cpos);
+    static size_t hashKey(uint64_t key);
+    static Region *tombstone();
+
+    static Directory *createDirectory(size_t capacity);
+    static void destroyDirectory(void *dir);
+    static void destroyRegion(void *reg);
+
+    Region *findRegion(const Directory *dir, uint64_t key) const;
+    Region *createRegion(uint64_t key);
+    void grow();
+
+    std::atomic<Directory*> m_dir;
+    std::atomic<size_t> m_size;
+    std::mutex m_writeLock;
+};
+
+#endif // CHUNKSTORE_HPP
@@ -31,9 +31,7 @@ void Client::recvHandler(kissnet::tcp_socket *sock)
                             ((uint32_t)data[4] << 16) |
                             ((uint32_t)data[5] << 8) |
                              (uint32_t)data[6];
-            GameWindow::m_seed = seed;
-            srand(GameWindow::m_seed);
-            GameWindow::gameInstance->regenerateWorld();
+            GameWindow::gameInstance->requestSeed(seed);
         }
         else if(data[0] == std::byte(0xB0)) // block update
         {
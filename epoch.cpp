@@ -0,0 +1,146 @@
+#include "epoch.hpp"
+
+#include <cassert>
+#include <cstdio>
+
+// per-thread slot registration, released on thread exit
+struct EpochThreadSlot
+{
+    int idx = -1;
+    int depth = 0;
+
+    ~EpochThreadSlot()
+    {
+        if(idx >= 0)
+            EpochManager::global().m_slots[idx].used.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local EpochThreadSlot tlsSlot;
+
+EpochManager::EpochManager()
+    : m_epoch(1), m_overflowReaders(0), m_overflowEpoch(0), m_pending(0)
+{
+    for(Slot &s : m_slots)
+    {
+        s.epoch.store(0);
+        s.used.store(false);
+    }
+}
+
+EpochManager::~EpochManager()
+{
+    for(Retired &r : m_retired)
+        r.del(r.ptr);
+}
+
+EpochManager &EpochManager::global()
+{
+    static EpochManager mgr;
+    return mgr;
+}
+
+EpochManager::Slot *EpochManager::threadSlot()
+{
+    if(tlsSlot.idx < 0)
+    {
+        for(int i=0; i < EPOCH_MAX_THREADS; i++)
+        {
+            bool expected = false;
+            if(m_slots[i].used.compare_exchange_strong(expected, true))
+            {
+                tlsSlot.idx = i;
+                break;
+            }
+        }
+    }
+    return tlsSlot.idx < 0 ? nullptr : &m_slots[tlsSlot.idx];
+}
+
+void EpochManager::enter()
+{
+    if(tlsSlot.depth++ > 0)
+        return;
+
+    if(Slot *s = threadSlot())
+    {
+        s->epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return;
+    }
+
+    // all slots taken by live readers, the oldest overflow reader's epoch stands for all of them
+    static std::atomic<bool> warned(false);
+    if(!warned.exchange(true))
+        fprintf(stderr, "[epoch] more than %d reader threads, the rest share one slot\n", EPOCH_MAX_THREADS);
+    std::lock_guard<std::mutex> lock(m_overflowLock);
+    if(m_overflowReaders++ == 0)
+        m_overflowEpoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochManager::leave()
+{
+    assert(tlsSlot.depth > 0);
+    if(--tlsSlot.depth > 0)
+        return;
+
+    if(tlsSlot.idx >= 0)
+    {
+        m_slots[tlsSlot.idx].epoch.store(0, std::memory_order_release);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_overflowLock);
+    if(--m_overflowReaders == 0)
+        m_overflowEpoch.store(0, std::memory_order_release);
+}
+
+void EpochManager::retire(void *ptr, Deleter del)
+{
+    std::lock_guard<std::mutex> lock(m_retiredLock);
+    m_retired.push_back({ptr, del, m_epoch.load(std::memory_order_seq_cst)});
+    m_pending.store(m_retired.size(), std::memory_order_relaxed);
+}
+
+size_t EpochManager::reclaim()
+{
+    if(m_pending.load(std::memory_order_relaxed) == 0)
+        return 0;
+
+    std::vector<Retired> freeable;
+    {
+        std::lock_guard<std::mutex> lock(m_retiredLock);
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        uint64_t minActive = m_overflowEpoch.load(std::memory_order_seq_cst);
+        if(minActive == 0)
+            minActive = UINT64_MAX;
+        for(Slot &s : m_slots)
+        {
+            const uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+            if(e != 0 && e < minActive)
+                minActive = e;
+        }
+
+        size_t keep = 0;
+        for(size_t i=0; i < m_retired.size(); i++)
+        {
+            if(m_retired[i].epoch < minActive)
+                freeable.push_back(m_retired[i]);
+            else
+                m_retired[keep++] = m_retired[i];
+        }
+        m_retired.resize(keep);
+        m_pending.store(keep, std::memory_order_relaxed);
+    }
+
+    for(Retired &r : freeable)
+        r.del(r.ptr);
+    return freeable.size();
+}
+
+size_t EpochManager::pending() const
+{
+    return m_pending.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,78 @@
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define EPOCH_MAX_THREADS (64) // reader threads with a slot of their own, the rest share one
+
+// Epoch-based reclamation for lock-free readers.
+// Readers bracket their accesses with enter()/leave() (or an EpochGuard);
+// writers unlink an object first and then retire() it. reclaim() frees
+// retired objects once no reader can still hold a reference.
+// Past EPOCH_MAX_THREADS concurrent readers, enter() falls back to a shared
+// overflow slot behind a mutex that holds the oldest epoch of its readers
+// until the last one leaves: slower, and reclaim waits longer, but it never blocks.
+class EpochManager
+{
+public:
+    typedef void (*Deleter)(void*);
+
+    ~EpochManager();
+
+    void enter();
+    void leave();
+
+    void retire(void *ptr, Deleter del);
+    // returns number of objects freed
+    size_t reclaim();
+    size_t pending() const;
+
+    static EpochManager &global();
+private:
+    EpochManager();
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch; // 0 when not inside a read section
+        std::atomic<bool> used;
+    };
+
+    struct Retired
+    {
+        void *ptr;
+        Deleter del;
+        uint64_t epoch;
+    };
+
+    // nullptr if every slot is taken
+    Slot *threadSlot();
+
+    std::atomic<uint64_t> m_epoch;
+    Slot m_slots[EPOCH_MAX_THREADS];
+
+    std::mutex m_overflowLock;
+    size_t m_overflowReaders;
+    std::atomic<uint64_t> m_overflowEpoch; // 0 without overflow readers
+
+    mutable std::mutex m_retiredLock;
+    std::vector<Retired> m_retired;
+    std::atomic<size_t> m_pending;
+
+    friend struct EpochThreadSlot;
+};
+
+class EpochGuard
+{
+public:
+    EpochGuard() { EpochManager::global().enter(); }
+    ~EpochGuard() { EpochManager::global().leave(); }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard &operator=(const EpochGuard&) = delete;
+};
+
+#endif // EPOCH_HPP
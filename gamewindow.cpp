@@ -6,10 +6,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <algorithm>
-#include <future>
 #include <thread>
 
 #include "chunk.hpp"
+#include "chunkpool.hpp"
+#include "world.hpp"
 
 #include "dda.hpp"
 #include "ray.hpp"
@@ -20,12 +21,12 @@ int GameWindow::m_scrWidth  = 0;
 int GameWindow::m_scrHeight = 0;
 uint32_t GameWindow::m_seed = 0;
 
-GameWindow::GameWindow(int width, int height)
-    : m_quit(false), m_ticksElapsed(0),
+GameWindow::GameWindow(int width, int height, uint32_t seed)
+    : m_quit(false), m_ticksElapsed(0), m_worldReady(false), m_seedPending(false), m_pendingSeed(0), m_lastColumn(0),
       m_svHandle(nullptr), m_clHandle(nullptr)
 {
     GameWindow::gameInstance = this;
-    GameWindow::m_seed = time(0);
+    GameWindow::m_seed = seed ? seed : time(0);
     srand(GameWindow::m_seed);
 
     m_scrWidth  = width;
@@ -50,10 +51,25 @@ GameWindow::GameWindow(int width, int height)
     m_texmgr = new TexManager();
     m_mdlmgr = new MdlManager();
 
+    m_storage = new RegionStorage(WORLD_SAVE_DIR "/" + std::to_string(m_seed));
+    m_journal = new BlockJournal(m_storage->directory());
+    m_saver = new WorldSaver(m_chunks, m_storage);
+    m_saver->setJournal(m_journal);
+    m_residency = new ChunkResidency(m_chunks);
+    m_residency->setViewRadius(STREAM_RADIUS);
+    // modified chunks are written on their way out
+    m_residency->setSaveHook([this](Chunk *ch) { return m_saver->save(ch); });
+    m_generator = new WorldGenerator(m_chunks, JobSystem::instance(), m_seed);
+    m_generator->setCacheDir(TCACHE_DIR);
+    m_generator->setStorage(m_storage);
+    // changes a crash kept out of the region files, before any snapshot rotates the journal
+    m_saver->recover(*m_generator, JobSystem::instance());
+    m_streamer = new ChunkStreamer(m_chunks, *m_generator, JobSystem::instance());
+
     m_camera = new Camera(90.f, (float)width / (float)height);
     m_camera->restrict(glm::vec3(1, 0, 0), -glm::pi<float>()/2.f, glm::pi<float>()/2.f);
 
-    m_camera->setPos(glm::vec3(1, 16*4, 1));
+    m_camera->setPos(glm::vec3(1, WORLD_HEIGHT, 1));
 
     loadConfig();
 }
@@ -156,22 +172,67 @@ void GameWindow::connect(const std::string &ip, uint16_t port)
     m_clHandle->sendPlayerInfo(m_selfInfo);
 }
 
-void GameWindow::regenerateWorld()
+void GameWindow::saveWorld()
 {
-    m_chunks.clear();
+    m_saver->flush();
+    const WorldSaver::Stats before = m_saver->stats();
+    m_saver->capture();
+    m_saver->flush();
+
+    const WorldSaver::Stats st = m_saver->stats();
+    if(st.chunks != before.chunks || st.failed != before.failed)
+        fprintf(stderr, "[world] saved %zu chunks to %s, %zu failed\n", st.chunks - before.chunks,
+                m_storage->directory().c_str(), st.failed - before.failed);
+}
 
-    std::vector<std::future<void>> chunkFutures;
-    const int ch_x = 64, ch_z = 64;
-    for(int i=0; i < ch_x; i++)
+void GameWindow::unloadWorld()
+{
+    m_streamer->reset();
+    saveWorld(); // into the old seed's directory, m_seed may already be the new one
+    // waits for the generator's jobs, nothing uses the old storage past this
+    m_generator->reset(m_seed);
+
+    const std::string dir = WORLD_SAVE_DIR "/" + std::to_string(m_seed);
+    const bool opened = (m_storage->directory() != dir);
+    if(opened)
     {
-        for(int j=0; j < ch_z; j++)
+        m_generator->setStorage(nullptr);
+        m_saver->setJournal(nullptr);
+        delete m_journal;
+        delete m_storage;
+        m_storage = new RegionStorage(dir);
+        m_journal = new BlockJournal(dir);
+        m_saver->setStorage(m_storage);
+        m_saver->setJournal(m_journal);
+    }
+    m_generator->setStorage(m_storage);
+
+    {
+        EpochGuard guard;
+        m_chunks.forEach([this](Chunk *ch)
         {
-            glm::ivec2 chPos = glm::ivec2(i - ch_x/2, j - ch_z/2);
-            chunkFutures.push_back(std::async(std::launch::async, Chunk::generateChunk, chPos, std::ref(m_chunks)));
-        }
+            Chunk *old = m_chunks.remove(ch->getPos());
+            if(old != nullptr)
+                ChunkStore::retire(old);
+        });
     }
-    for(std::future<void> &f : chunkFutures) // wait for chunks
-        f.get();
+    // the new directory's journal, before the next snapshot
+    if(opened)
+        m_saver->recover(*m_generator, JobSystem::instance());
+}
+
+void GameWindow::requestSeed(uint32_t seed)
+{
+    m_pendingSeed = seed;
+    m_seedPending = true;
+}
+
+// columns are streamed back in around the camera by m_streamer
+void GameWindow::regenerateWorld()
+{
+    unloadWorld();
+    m_worldReady = true;
+    fprintf(stderr, "[world] seed %u\n", m_seed);
 }
 
 PlayerInfo *GameWindow::spawnPlayer(uint16_t pid)
@@ -205,15 +266,27 @@ void GameWindow::removePlayer(uint16_t pid)
     }
 }
 
+// network threads only queue, chunk data is written by the main loop
 void GameWindow::updateBlock(const glm::ivec3 &pos, int bid)
 {
-    std::string cid = asString(glm::ivec3(pos / 4));
-    Chunk::chunkMutex->lock();
-    if(m_chunks.find(cid) != m_chunks.end())
+    m_blockUpdatesLock.lock();
+    m_blockUpdates.push_back({pos, bid});
+    m_blockUpdatesLock.unlock();
+}
+
+void GameWindow::applyBlockUpdates()
+{
+    std::vector<BlockUpdate> updates;
+    m_blockUpdatesLock.lock();
+    updates.swap(m_blockUpdates);
+    m_blockUpdatesLock.unlock();
+
+    World world(m_chunks);
+    for(const BlockUpdate &u : updates)
     {
-        m_chunks[cid]->setBlock(pos%4, bid);
+        if(world.setBlock(u.pos, u.bid))
+            m_journal->append(u.pos, u.bid);
     }
-    Chunk::chunkMutex->unlock();
 }
 
 uint16_t GameWindow::selfPID() const
@@ -258,17 +331,42 @@ int GameWindow::exec()
     int keymap[512];
     memset(keymap, 0, 512*sizeof(int));
     //
+    size_t streamed = 0;
     bool lastPosValid = false;
     glm::ivec3 lastPos;
     //
     SDL_Event ev;
     while(!m_quit)
     {
+        // the server's seed, nothing else runs on the world while it's swapped
+        if(m_seedPending.exchange(false))
+        {
+            m_worldReady = false;
+            m_seed = m_pendingSeed;
+            srand(m_seed);
+            regenerateWorld();
+        }
+
+        EpochManager::global().enter();
+        applyBlockUpdates();
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glm::ivec3 curChunk = glm::ivec3(m_camera->getPos().x/CHUNK_WIDTH,
-                                         m_camera->getPos().y/CHUNK_HEIGHT,
-                                         m_camera->getPos().z/CHUNK_DEPTH);
+        glm::ivec3 curChunk = Chunk::toChunkPos(glm::ivec3(glm::floor(m_camera->getPos())));
+
+        World world(m_chunks);
+        if(m_worldReady) // clients wait for the server's seed
+        {
+            m_streamer->update(m_camera->getPos(), m_camera->fwdVector());
+
+            // saved chunks the streamer will ask for next
+            const glm::ivec2 column(curChunk.x, curChunk.z);
+            if(column != m_lastColumn)
+            {
+                m_storage->prefetch(column, column - m_lastColumn, STREAM_RADIUS);
+                m_lastColumn = column;
+            }
+        }
 
         // TODO: RAYCASTING
         Ray rayCast(m_camera->getPos(),
@@ -277,18 +375,11 @@ int GameWindow::exec()
         lastPosValid = false;
         do
         {
-            glm::ivec3 chPos = glm::ivec3(ceil(rayCast.getPos().x / 4.f),
-                                          ceil(rayCast.getPos().y / 4.f),
-                                          ceil(rayCast.getPos().z / 4.f));
-            std::string cid = asString(chPos);
-            if(m_chunks.find(cid) == m_chunks.end())
-                continue;
-            Chunk *ch = m_chunks[cid];
-            int bid;
-            if((bid = ch->getBlock(glm::ivec3(rayCast.getPos())%4)) > 0)
+            glm::ivec3 bPos = glm::ivec3(glm::floor(rayCast.getPos()));
+            if(world.getBlock(bPos) > 0)
             {
                 lastPosValid = true;
-                lastPos = rayCast.getPos();
+                lastPos = bPos;
                 break;
             }
         } while (rayCast.step(0.2f));
@@ -327,9 +418,9 @@ int GameWindow::exec()
                 {
                     if(!lastPosValid)
                         continue;
-                    std::string cid = asString(glm::ivec3(ceil(lastPos.x/4.f), ceil(lastPos.y/4.f), ceil(lastPos.z/4.f)));
-                    Chunk *ch = m_chunks[cid];
-                    ch->setBlock(lastPos%4, 0);
+                    if(!world.setBlock(lastPos, 0))
+                        continue;
+                    m_journal->append(lastPos, 0);
 
                     if(m_clHandle)
                         m_clHandle->sendBlockUpdate(lastPos, 0);
@@ -393,25 +484,53 @@ int GameWindow::exec()
                                                   curChunk.y + k,
                                                   curChunk.z + j);
 
-                    std::string cid = asString(chPos);
-                    if(m_chunks.find(cid) == m_chunks.end())
+                    Chunk *ch = m_chunks.get(chPos);
+                    if(ch == nullptr)
+                        continue;
+                    ch->touch(m_ticksElapsed);
+                    if(ch->occupancy().none())
                         continue;
 
-                    Chunk *ch = m_chunks[cid];
-
-                    modelMatrix = glm::translate(glm::mat4(1.f), 4.f * glm::vec3(ch->getPos()));
+                    // only blocks with a face open to air are uploaded
+                    const Chunk::Mask *neighbors[Chunk::FACE_COUNT];
+                    for(int f = 0; f < Chunk::FACE_COUNT; f++)
+                    {
+                        glm::ivec3 npos = chPos + Chunk::faceNormal(f);
+                        Chunk *n = m_chunks.get(npos);
+                        if(n != nullptr)
+                            neighbors[f] = &n->occupancy();
+                        else // nothing below the world, unloaded neighbors count as air
+                            neighbors[f] = (npos.y < 0) ? &Chunk::fullMask() : nullptr;
+                    }
+                    const Chunk::Mask visible = ch->exposed(neighbors);
+                    if(visible.none())
+                        continue;
 
-                    int chunkPart[64];
-                    for(int m = 0; m < 64; m++)
-                        chunkPart[m] = ch->data()[m];
+                    modelMatrix = glm::translate(glm::mat4(1.f), glm::vec3(ch->getPos() * Chunk::size()));
+
+                    // exposed cubes only, block index << 16 | id, CUBE_BATCH per draw
+                    int chunkPart[Chunk::VOLUME];
+                    int instances = 0;
+                    for(int m = 0; m < Chunk::VOLUME; m++)
+                    {
+                        const int id = visible[m] ? ch->getBlockAt(m) : 0;
+                        if(id != 0)
+                            chunkPart[instances++] = (m << 16) | id;
+                    }
+                    if(instances == 0)
+                        continue;
 
                     cubeShader->use();
                     cubeShader->setMat4("Proj", m_camera->GetProjection());
                     cubeShader->setMat4("View", m_camera->GetView());
                     cubeShader->setMat4("Model", modelMatrix);
                     cubeShader->setInt("palette", 1); // texture unit 1
-                    cubeShader->setIntArray("chunk", chunkPart, 64);
-                    glDrawArraysInstanced(GL_TRIANGLES, 0, cubeMdl->getSize(), 64);
+                    for(int first = 0; first < instances; first += CUBE_BATCH)
+                    {
+                        const int count = std::min(CUBE_BATCH, instances - first);
+                        cubeShader->setIntArray("chunk", chunkPart + first, count);
+                        glDrawArraysInstanced(GL_TRIANGLES, 0, cubeMdl->getSize(), count);
+                    }
                 }
             }
         }
@@ -472,13 +591,57 @@ int GameWindow::exec()
 
         m_camera->update();
         SDL_GL_SwapWindow(m_window);
+
+        if(m_ticksElapsed % JOURNAL_COMMIT_TICKS == 0)
+            m_journal->commit();
+        // autosave, the writes happen on the saver's thread
+        if(m_worldReady && m_ticksElapsed % SAVE_INTERVAL_TICKS == SAVE_INTERVAL_TICKS - 1)
+            m_saver->capture();
+        if(m_saver->poll())
+        {
+            const WorldSaver::Stats sv = m_saver->stats();
+            fprintf(stderr, "[save] %zu chunks captured in %.2f ms, written in %.1f ms, %zu copied by edits so far\n",
+                    sv.lastChunks, sv.captureMs, sv.writeMs, sv.detached);
+        }
+
+        if(m_ticksElapsed % 60 == 0)
+        {
+            const size_t evicted = m_residency->stats().evicted;
+            m_residency->update(curChunk);
+
+            const ChunkResidency::Stats &st = m_residency->stats();
+            if(st.evicted != evicted)
+                fprintf(stderr, "[residency] %zu chunks (%zu KiB) resident, %zu (%zu KiB) evicted\n",
+                        st.resident, st.residentBytes >> 10, st.evicted, st.evictedBytes >> 10);
+
+            const ChunkStreamer::Stats ss = m_streamer->stats();
+            const glm::ivec3 camBlock = glm::ivec3(glm::floor(m_camera->getPos()));
+            char title[160];
+            snprintf(title, sizeof(title), GAME_TITLE " | %s | queue %zu, in flight %zu, %zu columns, %.1f ms avg",
+                     BiomeMap::name(Server::getBiome(camBlock.x, camBlock.z)),
+                     ss.queued, ss.inFlight, ss.generated, ss.avgLatencyMs);
+            SDL_SetWindowTitle(m_window, title);
+            if(ss.generated != streamed)
+            {
+                ChunkPool::Stats ps = ChunkPool::instance().stats();
+                TerrainCache::Stats cs = m_generator->cacheStats();
+                fprintf(stderr, "[stream] %zu columns, latency %.1f ms avg / %.1f ms max, %zu queued, %zu partial, %zu chunks in %zu slabs, cache %zu hits / %zu misses\n",
+                        ss.generated, ss.avgLatencyMs, ss.maxLatencyMs, ss.queued, m_generator->pendingColumns(),
+                        m_chunks.size(), ps.slabs, cs.hits, cs.misses);
+                RegionStorage::Stats rs = m_storage->stats();
+                if(rs.loaded > 0)
+                    fprintf(stderr, "[region] %zu chunks loaded (%zu mapped, %zu copied on change), %.1f us avg / %.1f us max, %zu minor / %zu major faults, %zu prefetched\n",
+                            rs.loaded, rs.mapped, rs.promoted, rs.avgLoadUs, rs.maxLoadUs, rs.minorFaults, rs.majorFaults, rs.prefetched);
+                streamed = ss.generated;
+            }
+        }
+        EpochManager::global().leave();
+        EpochManager::global().reclaim();
         m_ticksElapsed++;
     }
     //
-    /*
-    for(auto &p : chunks)
-        delete p.second;
-    */
+    unloadWorld();
+    EpochManager::global().reclaim();
     //
     cleanup();
     return 0;
@@ -494,6 +657,12 @@ void GameWindow::cleanup()
     if(m_svHandle)
         delete m_svHandle;
 
+    delete m_streamer;
+    delete m_generator;
+    delete m_residency;
+    delete m_saver;
+    delete m_journal;
+    delete m_storage;
     delete m_mdlmgr;
     delete m_texmgr;
     delete m_shmgr;
@@ -507,8 +676,13 @@ void GameWindow::loadConfig()
 {
     m_shmgr->loadShader({"data/shaders/main.vert",
                          "data/shaders/main.frag"}, "main");
+    // chunk[] holds block index << 16 | id, the index is Chunk::index(), x*D*H + y*D + z
     m_shmgr->loadShader({"data/shaders/cube.vert",
-                         "data/shaders/cube.frag"}, "cube");
+                         "data/shaders/cube.frag"}, "cube",
+                        "#define CUBE_BATCH " + std::to_string(CUBE_BATCH) + "\n"
+                        "#define CHUNK_WIDTH " + std::to_string(Chunk::WIDTH) + "\n"
+                        "#define CHUNK_HEIGHT " + std::to_string(Chunk::HEIGHT) + "\n"
+                        "#define CHUNK_DEPTH " + std::to_string(Chunk::DEPTH) + "\n");
     m_shmgr->loadShader({"data/shaders/cursor.vert",
                          "data/shaders/cursor.frag",
                          "data/shaders/cursor.geom"}, "cursor");
@@ -2,6 +2,8 @@
 #define GAMEWINDOW_HPP
 
 #define GAME_TITLE "ScienceCraft"
+#define WORLD_SAVE_DIR "world" // edited chunks and their journal, one subdirectory per seed
+#define CUBE_BATCH (64) // length of cube.vert's chunk[] uniform, cubes per instanced draw
 
 #include <SDL2/SDL.h>
 
@@ -13,7 +15,14 @@
 
 #include "server.hpp"
 #include "client.hpp"
+#include "chunkstore.hpp"
+#include "journal.hpp"
+#include "regionfile.hpp"
+#include "residency.hpp"
+#include "streamer.hpp"
+#include "worldsaver.hpp"
 #include <list>
+#include <atomic>
 #include <mutex>
 
 struct PlayerInfo
@@ -30,19 +39,23 @@ struct BlockUpdate
     int bid;
 };
 
-class Chunk;
-
 class GameWindow
 {
 public:
-    GameWindow(int width=1280, int height=720);
+    GameWindow(int width=1280, int height=720, uint32_t seed=0); // seed 0 picks one from the clock
 
     void initGL();
 
     void host(uint16_t port); // create server
     void connect(const std::string &ip, uint16_t port); // connect to server
 
+    // main thread only, they swap the storage, journal and generator seed
     void regenerateWorld();
+    void unloadWorld();
+    // any thread; the main loop switches to the seed at the start of its next frame
+    void requestSeed(uint32_t seed);
+    // writes every modified chunk to the region files and waits for it
+    void saveWorld();
 
     PlayerInfo *spawnPlayer(uint16_t pid);
     void updatePlayer(uint16_t pid, const glm::vec3 &np, const glm::vec2 &nr);
@@ -67,6 +80,8 @@ public:
 private:
     void createCursor();
 
+    void applyBlockUpdates();
+
     bool m_quit;
     SDL_GLContext m_glctx;
     SDL_Window *m_window;
@@ -82,7 +97,20 @@ private:
     GLuint m_cursorVAO, m_cursorVBO;
     GLuint m_quadVAO, m_quadVBO;
 
-    std::unordered_map<std::string, Chunk*> m_chunks;
+    ChunkStore m_chunks;
+    ChunkResidency *m_residency;
+    RegionStorage *m_storage;
+    BlockJournal *m_journal; // changes since the last snapshot
+    WorldSaver *m_saver;
+    WorldGenerator *m_generator;
+    ChunkStreamer *m_streamer;
+    std::atomic<bool> m_worldReady;
+    std::atomic<bool> m_seedPending; // m_pendingSeed is set
+    std::atomic<uint32_t> m_pendingSeed;
+    glm::ivec2 m_lastColumn; // camera column, drives region prefetch
+
+    std::mutex m_blockUpdatesLock;
+    std::vector<BlockUpdate> m_blockUpdates;
 
     // Multiplayer
     std::unordered_map<uint16_t, PlayerInfo*> m_players;
@@ -0,0 +1,204 @@
+#include "jobsystem.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // worker index of the calling thread, -1 outside the pool
+    thread_local const JobSystem *t_owner = nullptr;
+    thread_local int t_worker = -1;
+}
+
+bool JobSystem::Handle::done() const
+{
+    if(m_job == nullptr)
+        return true;
+    std::lock_guard<std::mutex> lk(m_job->lock);
+    return m_job->done;
+}
+
+JobSystem::JobSystem(unsigned threads)
+    : m_next(0), m_queued(0), m_stop(false)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for(unsigned i=0; i < threads; i++)
+        m_workers.emplace_back(new Worker);
+    for(unsigned i=0; i < threads; i++)
+        m_threads.emplace_back(&JobSystem::workerLoop, this, (int)i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_sleepLock);
+        m_stop = true;
+    }
+    m_sleepCv.notify_all();
+    for(std::thread &t : m_threads)
+        t.join();
+}
+
+JobSystem &JobSystem::instance()
+{
+    static JobSystem js;
+    return js;
+}
+
+unsigned JobSystem::workerCount() const
+{
+    return m_workers.size();
+}
+
+int JobSystem::currentWorker() const
+{
+    return (t_owner == this) ? t_worker : -1;
+}
+
+JobSystem::Handle JobSystem::submit(const Task &fn, Priority prio, const std::vector<Handle> &deps)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->fn = fn;
+    job->prio = prio;
+    job->pending = 1;
+    job->done = false;
+
+    for(const Handle &d : deps)
+    {
+        if(d.m_job == nullptr)
+            continue;
+        std::lock_guard<std::mutex> lk(d.m_job->lock);
+        if(!d.m_job->done)
+        {
+            job->pending++;
+            d.m_job->dependents.push_back(job);
+        }
+    }
+
+    release(job);
+    return Handle(job);
+}
+
+// drops one pending count, queues the job when nothing is left
+void JobSystem::release(const std::shared_ptr<Job> &job)
+{
+    if(job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        schedule(job);
+}
+
+void JobSystem::schedule(const std::shared_ptr<Job> &job)
+{
+    int w = currentWorker();
+    if(w < 0)
+        w = m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+
+    m_queued.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lk(m_workers[w]->lock);
+        m_workers[w]->queues[job->prio].push_back(job);
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(m_sleepLock);
+    }
+    m_sleepCv.notify_one();
+}
+
+void JobSystem::finish(const std::shared_ptr<Job> &job)
+{
+    std::vector<std::shared_ptr<Job>> dependents;
+    {
+        std::lock_guard<std::mutex> lk(job->lock);
+        job->done = true;
+        dependents.swap(job->dependents);
+    }
+    job->fn = nullptr; // drop captures early
+
+    for(const std::shared_ptr<Job> &d : dependents)
+        release(d);
+}
+
+std::shared_ptr<JobSystem::Job> JobSystem::take(int self)
+{
+    const int n = m_workers.size();
+    for(int p=0; p < PRIORITY_COUNT; p++)
+    {
+        // own queue newest first, then steal oldest from the others
+        if(self >= 0)
+        {
+            Worker &w = *m_workers[self];
+            std::lock_guard<std::mutex> lk(w.lock);
+            if(!w.queues[p].empty())
+            {
+                std::shared_ptr<Job> job = std::move(w.queues[p].back());
+                w.queues[p].pop_back();
+                return job;
+            }
+        }
+        const int start = (self >= 0) ? self + 1 : 0;
+        for(int i=0; i < n; i++)
+        {
+            const int v = (start + i) % n;
+            if(v == self)
+                continue;
+            Worker &w = *m_workers[v];
+            std::lock_guard<std::mutex> lk(w.lock);
+            if(!w.queues[p].empty())
+            {
+                std::shared_ptr<Job> job = std::move(w.queues[p].front());
+                w.queues[p].pop_front();
+                return job;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool JobSystem::runOne(int self)
+{
+    if(m_queued.load(std::memory_order_acquire) <= 0)
+        return false;
+
+    std::shared_ptr<Job> job = take(self);
+    if(job == nullptr)
+        return false;
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+
+    job->fn();
+    finish(job);
+    return true;
+}
+
+void JobSystem::workerLoop(int self)
+{
+    t_owner = this;
+    t_worker = self;
+
+    while(true)
+    {
+        if(runOne(self))
+            continue;
+
+        std::unique_lock<std::mutex> lk(m_sleepLock);
+        m_sleepCv.wait(lk, [this] { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+        if(m_stop)
+            break;
+    }
+}
+
+void JobSystem::wait(const Handle &h)
+{
+    const int self = currentWorker();
+    while(!h.done())
+    {
+        if(!runOne(self))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::wait(const std::vector<Handle> &handles)
+{
+    for(const Handle &h : handles)
+        wait(h);
+}
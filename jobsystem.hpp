@@ -0,0 +1,87 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads with per-worker deques and work stealing.
+// Workers run their own newest jobs first and steal the oldest from others;
+// higher priorities are always drained first. A job may depend on other
+// jobs and only becomes runnable once all of them finished.
+class JobSystem
+{
+    struct Job;
+public:
+    enum Priority { HIGH, NORMAL, LOW, PRIORITY_COUNT };
+    typedef std::function<void()> Task;
+
+    class Handle
+    {
+    public:
+        Handle() {}
+        bool valid() const { return m_job != nullptr; }
+        bool done() const;
+    private:
+        friend class JobSystem;
+        Handle(const std::shared_ptr<Job> &job) : m_job(job) {}
+        std::shared_ptr<Job> m_job;
+    };
+
+    // threads == 0 picks the core count; each worker takes one of the EPOCH_MAX_THREADS
+    // epoch slots for good, next to the main, saver, journal and network threads,
+    // so keep threads well under it: readers past the limit share a slower slot
+    JobSystem(unsigned threads = 0);
+    ~JobSystem();
+
+    Handle submit(const Task &fn, Priority prio = NORMAL, const std::vector<Handle> &deps = {});
+
+    // runs other jobs until h is done, so waiting from a worker can't deadlock
+    void wait(const Handle &h);
+    void wait(const std::vector<Handle> &handles);
+
+    unsigned workerCount() const;
+
+    static JobSystem &instance();
+private:
+    struct Job
+    {
+        Task fn;
+        Priority prio;
+        std::atomic<int> pending; // unfinished dependencies + 1 while submitting
+        std::mutex lock;
+        bool done;
+        std::vector<std::shared_ptr<Job>> dependents;
+    };
+
+    struct alignas(64) Worker
+    {
+        std::mutex lock;
+        std::deque<std::shared_ptr<Job>> queues[PRIORITY_COUNT];
+    };
+
+    void schedule(const std::shared_ptr<Job> &job);
+    void finish(const std::shared_ptr<Job> &job);
+    void release(const std::shared_ptr<Job> &job);
+    std::shared_ptr<Job> take(int self);
+    bool runOne(int self);
+    void workerLoop(int self);
+
+    int currentWorker() const;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<unsigned> m_next;
+    std::atomic<int> m_queued;
+    std::atomic<bool> m_stop;
+
+    std::mutex m_sleepLock;
+    std::condition_variable m_sleepCv;
+};
+
+#endif // JOBSYSTEM_HPP
@@ -0,0 +1,319 @@
+#include "journal.hpp"
+#include "mappedfile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <zlib.h>
+
+namespace
+{
+    const char journalMagic[4] = {'S', 'C', 'J', 'N'};
+
+    // segment header: magic, version; batch header: record count, crc32 of the records
+    const size_t SEGMENT_HEADER = 8;
+    const size_t BATCH_HEADER = 8;
+
+    uint32_t recordsCrc(const void *data, size_t bytes)
+    {
+        return crc32(crc32(0L, Z_NULL, 0), (const Bytef*)data, bytes);
+    }
+}
+
+BlockJournal::BlockJournal(const std::string &dir)
+    : m_dir(dir), m_segment(1), m_openSegment(1), m_replayed(false), m_busy(false), m_stop(false),
+      m_stats{0, 0, 0, 0, 0, 0, 0.0, 0.0}, m_commitMs(0.0), m_file(nullptr), m_fileSegment(0)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_dir, ec);
+    if(ec)
+        fprintf(stderr, "[journal] can't create %s: %s\n", m_dir.c_str(), ec.message().c_str());
+
+    // earlier runs' segments are left for replay, this run starts a new one
+    const std::vector<uint32_t> segs = segments();
+    if(!segs.empty())
+        m_segment = m_openSegment = segs.back() + 1;
+    m_thread = std::thread(&BlockJournal::run, this);
+}
+
+BlockJournal::~BlockJournal()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    if(m_file != nullptr)
+        fclose(m_file);
+}
+
+const std::string &BlockJournal::directory() const
+{
+    return m_dir;
+}
+
+BlockJournal::Stats BlockJournal::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    Stats s = m_stats;
+    s.avgCommitMs = s.batches > 0 ? m_commitMs / s.batches : 0.0;
+    return s;
+}
+
+std::string BlockJournal::segmentPath(uint32_t seg) const
+{
+    return m_dir + "/journal." + std::to_string(seg);
+}
+
+std::vector<uint32_t> BlockJournal::segments() const
+{
+    std::vector<uint32_t> segs;
+    std::error_code ec;
+    for(const auto &e : std::filesystem::directory_iterator(m_dir, ec))
+    {
+        const std::string name = e.path().filename().string();
+        if(name.rfind("journal.", 0) != 0 || name.size() == 8 ||
+           name.find_first_not_of("0123456789", 8) != std::string::npos)
+            continue;
+        segs.push_back(std::stoul(name.substr(8)));
+    }
+    std::sort(segs.begin(), segs.end());
+    return segs;
+}
+
+void BlockJournal::append(const glm::ivec3 &wpos, int id)
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_buffer.push_back({wpos.x, wpos.y, wpos.z, id});
+    m_stats.appended++;
+}
+
+void BlockJournal::commit()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        if(m_buffer.empty())
+            return;
+        m_queue.push_back({m_segment, false, {}});
+        m_queue.back().records.swap(m_buffer);
+    }
+    m_cv.notify_all();
+}
+
+void BlockJournal::flush()
+{
+    commit();
+    std::unique_lock<std::mutex> lk(m_lock);
+    m_doneCv.wait(lk, [this] { return m_queue.empty() && !m_busy; });
+}
+
+uint32_t BlockJournal::rotate()
+{
+    commit();
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_segment++;
+}
+
+void BlockJournal::drop(uint32_t seg)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_queue.push_back({seg, true, {}});
+    }
+    m_cv.notify_all();
+}
+
+size_t BlockJournal::replay(const std::function<void(const glm::ivec3&, int)> &fn)
+{
+    size_t replayed = 0;
+    for(uint32_t seg : segments())
+    {
+        if(seg >= m_openSegment)
+            break;
+
+        const std::string path = segmentPath(seg);
+        std::vector<uint8_t> data;
+        FILE *f = fopen(path.c_str(), "rb");
+        if(f != nullptr)
+        {
+            fseek(f, 0, SEEK_END);
+            data.resize(ftell(f));
+            fseek(f, 0, SEEK_SET);
+            if(fread(data.data(), 1, data.size(), f) != data.size())
+                data.clear();
+            fclose(f);
+        }
+
+        uint32_t version = 0;
+        if(data.size() >= SEGMENT_HEADER)
+            memcpy(&version, data.data() + 4, 4);
+        if(data.size() < SEGMENT_HEADER || memcmp(data.data(), journalMagic, 4) != 0 || version != JOURNAL_VERSION)
+        {
+            fprintf(stderr, "[journal] %s isn't a journal of this version, skipped\n", path.c_str());
+            continue;
+        }
+
+        size_t at = SEGMENT_HEADER;
+        while(data.size() - at >= BATCH_HEADER)
+        {
+            uint32_t count, crc;
+            memcpy(&count, data.data() + at, 4);
+            memcpy(&crc, data.data() + at + 4, 4);
+            const size_t bytes = (size_t)count * sizeof(Record);
+            if(count == 0 || bytes > data.size() - at - BATCH_HEADER ||
+               recordsCrc(data.data() + at + BATCH_HEADER, bytes) != crc)
+                break;
+
+            const uint8_t *p = data.data() + at + BATCH_HEADER;
+            for(uint32_t i=0; i < count; i++, p += sizeof(Record))
+            {
+                Record r;
+                memcpy(&r, p, sizeof(r));
+                fn(glm::ivec3(r.x, r.y, r.z), r.id);
+            }
+            replayed += count;
+            at += BATCH_HEADER + bytes;
+        }
+
+        // a crash mid-write leaves a torn batch at the end
+        if(at != data.size())
+        {
+            fprintf(stderr, "[journal] %s: dropping %zu bytes after the last intact batch\n",
+                    path.c_str(), data.size() - at);
+            std::error_code ec;
+            std::filesystem::resize_file(path, at, ec);
+        }
+    }
+    return replayed;
+}
+
+void BlockJournal::replayed()
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_replayed = true;
+}
+
+bool BlockJournal::write(uint32_t segment, const std::vector<Record> &records)
+{
+    if(m_file == nullptr || m_fileSegment != segment)
+    {
+        if(m_file != nullptr)
+            fclose(m_file);
+        m_fileSegment = segment;
+        const std::string path = segmentPath(segment);
+        m_file = fopen(path.c_str(), "ab");
+        if(m_file == nullptr)
+        {
+            fprintf(stderr, "[journal] can't open %s\n", path.c_str());
+            return false;
+        }
+        fseek(m_file, 0, SEEK_END);
+        if(ftell(m_file) == 0)
+        {
+            const uint32_t version = JOURNAL_VERSION;
+            fwrite(journalMagic, 1, 4, m_file);
+            fwrite(&version, sizeof(version), 1, m_file);
+        }
+    }
+
+    // one write per batch, the header and records together
+    const size_t bytes = records.size() * sizeof(Record);
+    std::vector<uint8_t> batch(BATCH_HEADER + bytes);
+    const uint32_t count = records.size();
+    const uint32_t crc = recordsCrc(records.data(), bytes);
+    memcpy(batch.data(), &count, 4);
+    memcpy(batch.data() + 4, &crc, 4);
+    memcpy(batch.data() + BATCH_HEADER, records.data(), bytes);
+
+    if(fwrite(batch.data(), 1, batch.size(), m_file) != batch.size() || !MappedFile::sync(m_file))
+    {
+        fprintf(stderr, "[journal] can't write %s\n", segmentPath(segment).c_str());
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void BlockJournal::remove(uint32_t upTo)
+{
+    if(m_file != nullptr && m_fileSegment <= upTo)
+    {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    bool replayed;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        replayed = m_replayed;
+    }
+
+    size_t dropped = 0;
+    for(uint32_t seg : segments())
+    {
+        // an earlier run's changes may not be in any snapshot yet
+        if(seg < m_openSegment && !replayed)
+            continue;
+        std::error_code ec;
+        if(seg <= upTo && std::filesystem::remove(segmentPath(seg), ec))
+            dropped++;
+    }
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_stats.dropped += dropped;
+}
+
+void BlockJournal::run()
+{
+    for(;;)
+    {
+        std::vector<Op> ops;
+        {
+            std::unique_lock<std::mutex> lk(m_lock);
+            m_cv.wait(lk, [this] { return m_stop || !m_queue.empty(); });
+            if(m_queue.empty()) // stopping
+                return;
+            ops.swap(m_queue);
+            m_busy = true;
+        }
+
+        // commits queued while the last batch was syncing go out together
+        size_t i = 0;
+        while(i < ops.size())
+        {
+            if(ops[i].drop)
+            {
+                remove(ops[i++].segment);
+                continue;
+            }
+
+            std::vector<Record> records;
+            const uint32_t segment = ops[i].segment;
+            for(; i < ops.size() && !ops[i].drop && ops[i].segment == segment; i++)
+                records.insert(records.end(), ops[i].records.begin(), ops[i].records.end());
+
+            const auto t = std::chrono::steady_clock::now();
+            const bool ok = write(segment, records);
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+
+            std::lock_guard<std::mutex> lk(m_lock);
+            if(!ok)
+                continue;
+            m_stats.committed += records.size();
+            m_stats.batches++;
+            m_stats.syncs++;
+            m_stats.bytes += BATCH_HEADER + records.size() * sizeof(Record);
+            m_stats.maxCommitMs = std::max(m_stats.maxCommitMs, ms);
+            m_commitMs += ms;
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(m_lock);
+            m_busy = false;
+        }
+        m_doneCv.notify_all();
+    }
+}
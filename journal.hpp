@@ -0,0 +1,104 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define JOURNAL_VERSION (1)
+#define JOURNAL_COMMIT_TICKS (10) // group commit period of the game loop, ~170 ms at 60 Hz
+
+// Append-only log of block changes next to the region files of a world.
+// append() only buffers; commit() hands the buffer to the journal thread,
+// which writes everything queued since its last pass as one batch and syncs
+// it once, so a burst of commits costs a single fsync. A batch is a record
+// count and a CRC-32 followed by 16-byte records; replay stops at the first
+// batch that is torn or fails its CRC and cuts the segment there.
+// The log is split in segments (journal.<n>). A snapshot rotates to a new
+// segment and drops the older ones once its chunks are synced, so the log
+// only ever holds changes made since the last completed save. Segments left
+// by earlier runs are never dropped until replayed() says their changes are
+// in the store, so a save before recovery can't lose them.
+class BlockJournal
+{
+public:
+    struct Stats
+    {
+        size_t appended, committed; // records
+        size_t batches, syncs;      // written
+        size_t bytes;
+        size_t dropped;             // segments folded into the region files
+        double avgCommitMs, maxCommitMs; // write and sync of a batch
+    };
+
+    explicit BlockJournal(const std::string &dir);
+    ~BlockJournal(); // commits and waits
+
+    BlockJournal(const BlockJournal&) = delete;
+    BlockJournal &operator=(const BlockJournal&) = delete;
+
+    void append(const glm::ivec3 &wpos, int id);
+    // queues what was appended so far
+    void commit();
+    // commits and blocks until everything queued is on disk
+    void flush();
+
+    // commits into the current segment and starts a new one, returns the finished segment
+    uint32_t rotate();
+    // deletes segments up to and including seg after the writes queued before it,
+    // earlier runs' segments only once replayed() was called
+    void drop(uint32_t seg);
+
+    // calls fn for every intact record of the segments left by earlier runs, oldest first;
+    // returns how many
+    size_t replay(const std::function<void(const glm::ivec3&, int)> &fn);
+    // the replayed changes are applied, the next drop may fold earlier runs' segments
+    void replayed();
+
+    Stats stats() const;
+    const std::string &directory() const;
+private:
+    struct Record
+    {
+        int32_t x, y, z, id;
+    };
+    struct Op
+    {
+        uint32_t segment;
+        bool drop;
+        std::vector<Record> records;
+    };
+
+    void run();
+    // thread side
+    bool write(uint32_t segment, const std::vector<Record> &records);
+    void remove(uint32_t upTo);
+    std::vector<uint32_t> segments() const;
+    std::string segmentPath(uint32_t seg) const;
+
+    std::string m_dir;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_cv, m_doneCv;
+    std::vector<Record> m_buffer;
+    std::vector<Op> m_queue;
+    uint32_t m_segment;
+    uint32_t m_openSegment; // first segment of this run, older ones are earlier runs'
+    bool m_replayed;
+    bool m_busy, m_stop;
+    Stats m_stats;
+    double m_commitMs;
+
+    // thread side
+    FILE *m_file;
+    uint32_t m_fileSegment;
+
+    std::thread m_thread;
+};
+
+#endif // JOURNAL_HPP
@@ -11,13 +11,76 @@ int WINAPI WinMain(HINSTANCE hInstance,
 #else
 */
 
+#include <chrono>
+
 #ifdef _WIN32
 #undef main
 #endif
 
+// generates (2*radius+1)^2 columns around the spawn into the terrain cache,
+// then loads them again to show the warm startup time
+static int pregen(uint32_t seed, int radius)
+{
+    fprintf(stderr, "[pregen] seed %u, radius %d\n", seed, radius);
+    ChunkStore store;
+    WorldGenerator gen(store, JobSystem::instance(), seed);
+    gen.setCacheDir(TCACHE_DIR);
+
+    for(int pass=0; pass < 2; pass++)
+    {
+        const TerrainCache::Stats before = gen.cacheStats();
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<JobSystem::Handle> handles;
+        for(int x=-radius; x <= radius; x++)
+        {
+            for(int z=-radius; z <= radius; z++)
+                handles.push_back(gen.request(glm::ivec2(x, z)));
+        }
+        JobSystem::instance().wait(handles);
+        gen.flushCache();
+
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const TerrainCache::Stats after = gen.cacheStats();
+        fprintf(stderr, "[pregen] %s: %zu columns in %.1f ms, %zu cache hits, %zu stored\n",
+                pass == 0 ? "cold" : "warm", handles.size(), ms,
+                after.hits - before.hits, after.stored - before.stored);
+
+        // drop everything so the second pass starts from an empty world
+        gen.reset(seed);
+        {
+            EpochGuard guard;
+            store.forEach([&store](Chunk *ch)
+            {
+                Chunk *old = store.remove(ch->getPos());
+                if(old != nullptr)
+                    ChunkStore::retire(old);
+            });
+        }
+        EpochManager::global().reclaim();
+    }
+    fprintf(stderr, "[pregen] cache in %s\n", TCACHE_DIR);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    GameWindow *win = new GameWindow(1280, 720);
+    uint32_t seed = 0;
+    for(int i=1; i+1 < argc; i++)
+    {
+        if(strcmp(argv[i], "--seed") == 0)
+            seed = strtoul(argv[i+1], nullptr, 10);
+    }
+    for(int i=1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--pregen") == 0)
+        {
+            assert((i+1) < argc && "Radius required");
+            return pregen(seed ? seed : time(0), atoi(argv[i+1]));
+        }
+    }
+
+    GameWindow *win = new GameWindow(1280, 720, seed);
 
     for(int i=1; i < argc; i++)
     {
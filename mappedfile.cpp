@@ -0,0 +1,176 @@
+#include "mappedfile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_mapped(false)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+#ifndef MAPPEDFILE_NO_MMAP
+    if(map(path))
+        return true;
+#endif
+    return read(path);
+}
+
+void MappedFile::close()
+{
+    if(m_mapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        munmap((void*)m_data, m_size);
+#endif
+    }
+    std::vector<uint8_t>().swap(m_buffer);
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+}
+
+bool MappedFile::map(const std::string &path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if(view == nullptr)
+    {
+        if(mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = (const uint8_t*)view;
+    m_size = size.QuadPart;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if(view == MAP_FAILED)
+        return false;
+
+    m_data = (const uint8_t*)view;
+    m_size = st.st_size;
+#endif
+    m_mapped = true;
+    return true;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+    if(!m_mapped || offset >= m_size)
+        return;
+#ifdef _WIN32
+    (void)length; // PrefetchVirtualMemory needs Windows 8, reads fault pages in as usual
+#else
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t begin = offset & ~(page - 1);
+    const size_t end = std::min(offset + length, m_size);
+    madvise((void*)(m_data + begin), end - begin, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::threadFaults(size_t &minor, size_t &major)
+{
+#ifdef RUSAGE_THREAD
+    struct rusage ru;
+    if(getrusage(RUSAGE_THREAD, &ru) == 0)
+    {
+        minor = ru.ru_minflt;
+        major = ru.ru_majflt;
+        return;
+    }
+#endif
+    minor = major = 0;
+}
+
+bool MappedFile::sync(FILE *f)
+{
+    if(fflush(f) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+bool MappedFile::read(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if(f == nullptr)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(size <= 0)
+    {
+        fclose(f);
+        return false;
+    }
+
+    m_buffer.resize(size);
+    const bool ok = fread(m_buffer.data(), 1, size, f) == (size_t)size;
+    fclose(f);
+    if(!ok)
+    {
+        std::vector<uint8_t>().swap(m_buffer);
+        return false;
+    }
+    m_data = m_buffer.data();
+    m_size = size;
+    return true;
+}
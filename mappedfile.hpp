@@ -0,0 +1,50 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+// Read-only view of a whole file. Memory-mapped where the platform allows,
+// otherwise (or with -DMAPPEDFILE_NO_MMAP) the file is read into memory.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    // false if the file can't be opened or read
+    bool open(const std::string &path);
+    void close();
+
+    inline const uint8_t *data() const { return m_data; }
+    inline size_t size() const { return m_size; }
+    // false when the contents were copied into memory
+    inline bool isMapped() const { return m_mapped; }
+
+    // hints that the range is read soon, ignored when copied or unsupported
+    void prefetch(size_t offset, size_t length) const;
+
+    // page faults of the calling thread so far, zeros where they aren't counted per thread
+    static void threadFaults(size_t &minor, size_t &major);
+    // flushes f and forces its data to disk
+    static bool sync(FILE *f);
+private:
+    bool map(const std::string &path);
+    bool read(const std::string &path);
+
+    const uint8_t *m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<uint8_t> m_buffer;
+#ifdef _WIN32
+    void *m_file, *m_mapping;
+#endif
+};
+
+#endif // MAPPEDFILE_HPP
@@ -0,0 +1,427 @@
+#include "palette.hpp"
+#include "chunk.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+template<int N>
+PalettedStorage<N>::PalettedStorage()
+    : m_words(m_inlineWords), m_palette(m_inlinePalette), m_refs(m_inlineRefs)
+{
+    fill(0);
+}
+
+template<int N>
+PalettedStorage<N>::PalettedStorage(const PalettedStorage &other)
+    : m_words(m_inlineWords), m_palette(m_inlinePalette), m_refs(m_inlineRefs)
+{
+    *this = other;
+}
+
+template<int N>
+PalettedStorage<N>::~PalettedStorage()
+{
+    releaseHeap();
+}
+
+template<int N>
+PalettedStorage<N> &PalettedStorage<N>::operator=(const PalettedStorage &other)
+{
+    if(this == &other)
+        return *this;
+
+    if(other.m_backing != nullptr)
+    {
+        // a borrowed copy shares the backing
+        releaseHeap();
+        m_words = other.m_words;
+        m_palette = other.m_palette;
+        m_refs = nullptr;
+        m_backing = other.m_backing;
+    }
+    else
+    {
+        allocate(other.m_bits);
+        memcpy(m_words, other.m_words, wordCount(other.m_bits)*sizeof(uint64_t));
+        memcpy(m_palette, other.m_palette, other.m_count*sizeof(uint16_t));
+        memcpy(m_refs, other.m_refs, other.m_count*sizeof(uint16_t));
+    }
+
+    m_live = other.m_live;
+    m_count = other.m_count;
+    setLayout(other.m_bits);
+    rebuildIndex();
+    return *this;
+}
+
+template<int N>
+typename PalettedStorage<N>::Layout PalettedStorage<N>::layoutFor(int bits)
+{
+    Layout l;
+    l.bits = bits;
+    l.bitShift = 0;
+    while(bits > 1 && (1 << l.bitShift) < bits)
+        l.bitShift++;
+    l.wordShift = 6 - l.bitShift;
+    l.slotMask  = (64 >> l.bitShift) - 1;
+    l.indexMask = (bits == 0) ? 0 : ((1ull << bits) - 1);
+    return l;
+}
+
+template<int N>
+int PalettedStorage<N>::minBits(int entries)
+{
+    if(entries <= 1)
+        return 0;
+    int bits = 1;
+    while((1 << bits) < entries)
+        bits <<= 1;
+    return bits;
+}
+
+template<int N>
+int PalettedStorage<N>::capacityFor(int bits)
+{
+    return std::min(1 << bits, N);
+}
+
+template<int N>
+int PalettedStorage<N>::hashCapacity(int bits)
+{
+    int hcap = 4;
+    while(hcap < capacityFor(bits)*2)
+        hcap <<= 1;
+    return hcap;
+}
+
+template<int N>
+size_t PalettedStorage<N>::heapWords(int bits)
+{
+    // index words, then palette, refcounts and the id table
+    return wordCount(bits) + ((capacityFor(bits)*2 + hashCapacity(bits))*sizeof(uint16_t) + 7) / 8;
+}
+
+template<int N>
+int PalettedStorage<N>::find(int id) const
+{
+    if(!ownsHeap())
+    {
+        for(int i=0; i < m_count; i++)
+        {
+            if(m_palette[i] == id)
+                return i;
+        }
+        return -1;
+    }
+
+    const uint16_t *t = table();
+    for(int h = hashId(id) & m_hashMask;; h = (h + 1) & m_hashMask)
+    {
+        if(t[h] == 0)
+            return -1;
+        if(m_palette[t[h] - 1] == id)
+            return t[h] - 1;
+    }
+}
+
+template<int N>
+void PalettedStorage<N>::placeIndex(int pidx)
+{
+    uint16_t *t = table();
+    int h = hashId(m_palette[pidx]) & m_hashMask;
+    while(t[h] != 0)
+        h = (h + 1) & m_hashMask;
+    t[h] = pidx + 1;
+    m_hashUsed++;
+}
+
+template<int N>
+void PalettedStorage<N>::insertIndex(int pidx)
+{
+    if(!ownsHeap())
+        return;
+    // stale entries only go away on a rebuild, keep the table at most 3/4 full
+    if((m_hashUsed + 1)*4 > (m_hashMask + 1)*3)
+        rebuildIndex();
+    else
+        placeIndex(pidx);
+}
+
+template<int N>
+void PalettedStorage<N>::rebuildIndex()
+{
+    m_hashUsed = 0;
+    if(!ownsHeap())
+        return;
+    memset(table(), 0, (m_hashMask + 1)*sizeof(uint16_t));
+    for(int i=0; i < m_count; i++)
+        placeIndex(i);
+}
+
+template<int N>
+void PalettedStorage<N>::setLayout(int bits)
+{
+    const Layout l = layoutFor(bits);
+    m_bits = bits;
+    m_bitShift = l.bitShift;
+    m_wordShift = l.wordShift;
+    m_slotMask = l.slotMask;
+    m_indexMask = l.indexMask;
+    m_hashMask = hashCapacity(bits) - 1;
+}
+
+template<int N>
+void PalettedStorage<N>::releaseHeap()
+{
+    if(ownsHeap())
+        delete[] m_words;
+    m_words = m_inlineWords;
+    m_palette = m_inlinePalette;
+    m_refs = m_inlineRefs;
+    m_backing.reset();
+}
+
+template<int N>
+void PalettedStorage<N>::allocate(int bits)
+{
+    uint64_t *heap = fitsInline(bits) ? nullptr : new uint64_t[heapWords(bits)];
+    releaseHeap();
+    if(heap != nullptr)
+    {
+        m_words = heap;
+        m_palette = reinterpret_cast<uint16_t*>(heap + wordCount(bits));
+        m_refs = m_palette + capacityFor(bits);
+    }
+}
+
+template<int N>
+bool PalettedStorage<N>::borrow(int bits, int count, int live, const uint16_t *palette, const uint64_t *words,
+                                std::shared_ptr<const void> backing)
+{
+    if(bits < 0 || bits > 16 || (bits & (bits-1)) != 0 || count < 1 || count > N || (1 << bits) < count ||
+       live < 1 || live > count)
+        return false;
+    if(bits > 0)
+    {
+        // every index must name an entry, the data comes from disk
+        const Layout l = layoutFor(bits);
+        for(int i=0; i < N; i++)
+        {
+            if((int)((words[i >> l.wordShift] >> ((i & l.slotMask) << l.bitShift)) & l.indexMask) >= count)
+                return false;
+        }
+    }
+
+    releaseHeap();
+    m_words = const_cast<uint64_t*>(words);
+    m_palette = const_cast<uint16_t*>(palette);
+    m_refs = nullptr;
+    m_backing = std::move(backing);
+    m_live = live;
+    m_count = count;
+    m_hashUsed = 0;
+    setLayout(bits);
+    return true;
+}
+
+template<int N>
+void PalettedStorage<N>::promote()
+{
+    // keep the borrowed memory alive until it's copied
+    const std::shared_ptr<const void> backing = std::move(m_backing);
+    const uint64_t *words = m_words;
+    const uint16_t *palette = m_palette;
+    m_words = m_inlineWords;
+
+    allocate(m_bits);
+    memcpy(m_words, words, wordCount(m_bits)*sizeof(uint64_t));
+    memcpy(m_palette, palette, m_count*sizeof(uint16_t));
+    std::fill(m_refs, m_refs + m_count, 0);
+    for(int i=0; i < N; i++)
+        m_refs[indexAt(i)]++;
+    rebuildIndex();
+    s_promotions.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<int N>
+void PalettedStorage<N>::fill(int id)
+{
+    releaseHeap();
+    m_palette[0] = id;
+    m_refs[0] = N;
+    m_live = m_count = 1;
+    m_hashUsed = 0;
+    setLayout(0);
+}
+
+template<int N>
+void PalettedStorage<N>::load(const uint16_t *ids)
+{
+    uint16_t pidx[N];
+    uint16_t palette[N], refs[N];
+    int count = 0, last = -1;
+    for(int i=0; i < N; i++)
+    {
+        // runs of one id are the common case
+        int p = last;
+        if(p < 0 || palette[p] != ids[i])
+        {
+            p = 0;
+            while(p < count && palette[p] != ids[i])
+                p++;
+            if(p == count)
+            {
+                palette[count] = ids[i];
+                refs[count++] = 0;
+            }
+            last = p;
+        }
+        refs[p]++;
+        pidx[i] = p;
+    }
+
+    const int bits = minBits(count);
+    allocate(bits);
+    memcpy(m_palette, palette, count*sizeof(uint16_t));
+    memcpy(m_refs, refs, count*sizeof(uint16_t));
+    memset(m_words, 0, wordCount(bits)*sizeof(uint64_t));
+    m_live = m_count = count;
+    setLayout(bits);
+    rebuildIndex();
+
+    if(bits > 0)
+    {
+        for(int i=0; i < N; i++)
+            writeIndex(i, pidx[i]);
+    }
+}
+
+template<int N>
+bool PalettedStorage<N>::set(int idx, int id)
+{
+    int old = indexAt(idx);
+    if(m_palette[old] == id)
+        return false;
+    if(m_backing != nullptr)
+        promote();
+
+    int pidx = find(id);
+    if(pidx < 0)
+    {
+        if(m_refs[old] == 1) // last user of the old id, rename in place
+        {
+            m_palette[old] = id;
+            insertIndex(old);
+            return true;
+        }
+
+        if(m_count >= capacityFor(m_bits))
+        {
+            // drop dead entries at this width, widen only once they're all live
+            repack(m_live < m_count ? m_bits : (m_bits == 0 ? 1 : m_bits*2));
+            old = indexAt(idx);
+        }
+        pidx = m_count++;
+        m_palette[pidx] = id;
+        m_refs[pidx] = 0;
+        m_live++;
+        insertIndex(pidx);
+    }
+    else if(m_refs[pidx] == 0)
+        m_live++; // dead entry comes back
+
+    writeIndex(idx, pidx);
+    m_refs[pidx]++;
+    if(--m_refs[old] == 0)
+    {
+        m_live--;
+        const int target = minBits(m_live);
+        if(target == 0 || target*4 <= m_bits)
+            repack(target);
+    }
+    return true;
+}
+
+template<int N>
+void PalettedStorage<N>::repack(int newBits)
+{
+    // compact palette to live entries in place, remap[i] <= i
+    uint16_t remap[N];
+    int live = 0;
+    for(int i=0; i < m_count; i++)
+    {
+        if(m_refs[i] == 0)
+            continue;
+        remap[i] = live;
+        m_palette[live] = m_palette[i];
+        m_refs[live] = m_refs[i];
+        live++;
+    }
+
+    const Layout l = layoutFor(newBits);
+    const int nwords = wordCount(newBits);
+    uint64_t words[(N*16 + 63) / 64];
+    memset(words, 0, nwords*sizeof(uint64_t));
+    if(newBits > 0)
+    {
+        for(int i=0; i < N; i++)
+        {
+            const int sh = (i & l.slotMask) << l.bitShift;
+            words[i >> l.wordShift] |= (uint64_t)remap[indexAt(i)] << sh;
+        }
+    }
+
+    if(newBits != m_bits)
+    {
+        uint16_t palette[N], refs[N];
+        memcpy(palette, m_palette, live*sizeof(uint16_t));
+        memcpy(refs, m_refs, live*sizeof(uint16_t));
+        allocate(newBits);
+        memcpy(m_palette, palette, live*sizeof(uint16_t));
+        memcpy(m_refs, refs, live*sizeof(uint16_t));
+    }
+    memcpy(m_words, words, nwords*sizeof(uint64_t));
+
+    m_live = m_count = live;
+    setLayout(newBits);
+    rebuildIndex();
+    s_repacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<int N>
+int PalettedStorage<N>::bits() const
+{
+    return m_bits;
+}
+
+template<int N>
+int PalettedStorage<N>::paletteSize() const
+{
+    return m_live;
+}
+
+template<int N>
+size_t PalettedStorage<N>::memoryUsage() const
+{
+    return sizeof(*this) + (ownsHeap() ? heapWords(m_bits)*sizeof(uint64_t) : 0);
+}
+
+template<int N>
+size_t PalettedStorage<N>::promotions()
+{
+    return s_promotions.load(std::memory_order_relaxed);
+}
+
+template<int N>
+size_t PalettedStorage<N>::repacks()
+{
+    return s_repacks.load(std::memory_order_relaxed);
+}
+
+template<int N>
+std::atomic<size_t> PalettedStorage<N>::s_promotions(0);
+
+template<int N>
+std::atomic<size_t> PalettedStorage<N>::s_repacks(0);
+
+template class PalettedStorage<Chunk::VOLUME>;
@@ -0,0 +1,132 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Per-chunk palette + bit-packed palette indices.
+// Index width is one of 0, 1, 2, 4, 8, 16 bits so entries never straddle
+// a 64-bit word; width 0 means a single palette entry and no index array.
+// Layouts of up to INLINE_PALETTE entries whose indices fit INLINE_WORDS
+// live inside the object, anything wider goes to one heap block holding the
+// index words, the palette, its refcounts and an open-addressed id->index
+// table, so set() finds an id without scanning the palette. Dead entries stay
+// in place until the palette fills up and are dropped by a repack of the same
+// width, which is the only time set() touches every index. A borrowed storage reads its
+// palette and indices from memory it doesn't own (a mapped file) and copies
+// them on the first change.
+template<int N>
+class PalettedStorage
+{
+    static_assert(N > 0 && N <= 32768, "palette refcounts are 16-bit");
+public:
+    static constexpr int INLINE_WORDS = 2;
+    static constexpr int INLINE_PALETTE = 4;
+
+    PalettedStorage();
+    PalettedStorage(const PalettedStorage &other);
+    PalettedStorage &operator=(const PalettedStorage &other);
+    ~PalettedStorage();
+
+    inline int get(int idx) const
+    {
+        if(m_bits == 0)
+            return m_palette[0];
+        const uint64_t w = m_words[idx >> m_wordShift];
+        return m_palette[(w >> ((idx & m_slotMask) << m_bitShift)) & m_indexMask];
+    }
+
+    // returns false if the block already had that id
+    bool set(int idx, int id);
+    void fill(int id);
+    // bulk load N ids, picks the narrowest width
+    void load(const uint16_t *ids);
+    // reads from palette and words in place until the first set(), backing keeps them alive;
+    // words must be 8-byte aligned, count includes dead entries, live doesn't;
+    // false (and unchanged) if the layout or an index is invalid
+    bool borrow(int bits, int count, int live, const uint16_t *palette, const uint64_t *words,
+                std::shared_ptr<const void> backing);
+
+    // single id, no index array
+    inline bool isUniform() const { return m_bits == 0; }
+
+    inline bool isBorrowed() const { return m_backing != nullptr; }
+
+    int bits() const;
+    int paletteSize() const; // live entries only
+    size_t memoryUsage() const;
+
+    // raw layout for serialization, paletteCount() includes dead entries
+    inline const uint16_t *palette() const { return m_palette; }
+    inline const uint64_t *words() const { return m_words; }
+    inline int paletteCount() const { return m_count; }
+    static constexpr int wordCount(int bits) { return (N*bits + 63) / 64; }
+    // no heap block needed at this width
+    static constexpr bool fitsInline(int bits) { return (1 << bits) <= INLINE_PALETTE && wordCount(bits) <= INLINE_WORDS; }
+
+    // borrowed storages copied on a change, and index arrays rewritten, process-wide
+    static size_t promotions();
+    static size_t repacks();
+private:
+    struct Layout
+    {
+        int bits, bitShift, wordShift;
+        uint64_t slotMask, indexMask;
+    };
+    static Layout layoutFor(int bits);
+    static int minBits(int entries);
+    static int capacityFor(int bits);
+    static int hashCapacity(int bits);
+    static size_t heapWords(int bits);
+    static inline int hashId(int id) { return ((uint32_t)id * 2654435761u) >> 16; }
+
+    inline int indexAt(int idx) const
+    {
+        if(m_bits == 0)
+            return 0;
+        return (m_words[idx >> m_wordShift] >> ((idx & m_slotMask) << m_bitShift)) & m_indexMask;
+    }
+    inline void writeIndex(int idx, int pidx)
+    {
+        const int sh = (idx & m_slotMask) << m_bitShift;
+        uint64_t &w = m_words[idx >> m_wordShift];
+        w = (w & ~((uint64_t)m_indexMask << sh)) | ((uint64_t)pidx << sh);
+    }
+    // palette index of id, dead entries included; -1 if absent
+    int find(int id) const;
+    // table entries are palette index + 1, renamed entries go stale and are verified on lookup
+    inline uint16_t *table() const { return m_refs + capacityFor(m_bits); }
+    void insertIndex(int pidx);
+    void placeIndex(int pidx);
+    void rebuildIndex();
+
+    void setLayout(int bits);
+    // points words, palette and refs at the inline arrays or a fresh heap block for bits, contents undefined
+    void allocate(int bits);
+    inline bool ownsHeap() const { return m_backing == nullptr && m_words != m_inlineWords; }
+    void repack(int newBits);
+    void releaseHeap();
+    void promote();
+
+    uint8_t m_bits, m_bitShift, m_wordShift, m_slotMask;
+    uint16_t m_indexMask;
+    uint16_t m_live;  // entries with refs > 0
+    uint16_t m_count; // allocated entries, live or dead
+    uint16_t m_hashUsed; // table slots taken, stale ones included
+    uint16_t m_hashMask; // table size - 1 at this width
+
+    uint64_t *m_words; // start of the heap block when not inline or borrowed
+    uint16_t *m_palette;
+    uint16_t *m_refs; // nullptr while borrowed
+    std::shared_ptr<const void> m_backing;
+
+    uint64_t m_inlineWords[INLINE_WORDS];
+    uint16_t m_inlinePalette[INLINE_PALETTE];
+    uint16_t m_inlineRefs[INLINE_PALETTE];
+
+    static std::atomic<size_t> s_promotions, s_repacks;
+};
+
+#endif // PALETTE_HPP
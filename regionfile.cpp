@@ -0,0 +1,656 @@
+#include "regionfile.hpp"
+#include "chunkpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <zlib.h>
+
+namespace
+{
+    const char regionMagic[4] = {'S', 'C', 'R', 'F'};
+
+    // record header: payload length, compression, crc32 of the uncompressed payload
+    const size_t RECORD_HEADER = 4 + 1 + 4;
+    const size_t BLOCK_BYTES = Chunk::VOLUME * sizeof(uint16_t);
+
+    // palette payload, offsets from the record start so the words stay 8-byte aligned:
+    // padding, then bits, unused, count, live, unused, the palette and the words
+    const size_t PALETTE_META = 16;
+    const size_t PALETTE_ENTRIES = PALETTE_META + 8;
+
+    constexpr size_t paletteWordsAt(int count)
+    {
+        return (PALETTE_ENTRIES + count*sizeof(uint16_t) + 7) & ~(size_t)7;
+    }
+
+    constexpr uint32_t sectors(size_t bytes)
+    {
+        return (bytes + REGIONFILE_SECTOR - 1) / REGIONFILE_SECTOR;
+    }
+
+    // largest record encode() writes: a 16-bit palette layout, or the raw blocks
+    constexpr size_t MAX_RECORD = std::max(paletteWordsAt(Chunk::VOLUME) +
+                                           PalettedStorage<Chunk::VOLUME>::wordCount(16) * sizeof(uint64_t),
+                                           RECORD_HEADER + BLOCK_BYTES);
+
+    // table entry: first sector above a count field wide enough for MAX_RECORD,
+    // 8 bits (what version 1 and 2 files use) unless the chunks are large
+    constexpr int countBits(uint32_t count)
+    {
+        int bits = 8;
+        while((1u << bits) <= count)
+            bits++;
+        return bits;
+    }
+    constexpr int COUNT_BITS = countBits(sectors(MAX_RECORD));
+
+    inline uint32_t entryFirst(uint32_t e) { return e >> COUNT_BITS; }
+    inline uint32_t entryCount(uint32_t e) { return e & ((1u << COUNT_BITS) - 1); }
+    inline uint32_t makeEntry(uint32_t first, uint32_t count) { return (first << COUNT_BITS) | count; }
+
+    void finishRecord(std::vector<uint8_t> &record, uint8_t compression, uint32_t crc)
+    {
+        const uint32_t length = record.size() - RECORD_HEADER;
+        memcpy(record.data(), &length, 4);
+        record[4] = compression;
+        memcpy(record.data() + 5, &crc, 4);
+    }
+}
+
+RegionFile::RegionFile()
+    : m_file(nullptr), m_fileSize(0)
+{
+
+}
+
+RegionFile::~RegionFile()
+{
+    close();
+}
+
+int RegionFile::slot(const glm::ivec3 &cpos)
+{
+    return (((cpos.x & (REGIONFILE_COLUMNS-1)) << REGIONFILE_SHIFT) | (cpos.z & (REGIONFILE_COLUMNS-1))) * Chunk::COLUMN_HEIGHT + cpos.y;
+}
+
+bool RegionFile::open(const std::string &path, bool create)
+{
+    // every chunk at its largest, twice over for records a pinned file leaves behind
+    static_assert(HEADER_SECTORS + 2ull * CHUNKS * sectors(MAX_RECORD) < (1ull << (32 - COUNT_BITS)),
+                  "region file sectors don't fit a table entry, lower REGIONFILE_SHIFT");
+    close();
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_path = path;
+    m_table.assign(CHUNKS, 0);
+    m_used.assign(HEADER_SECTORS, true);
+
+    Header h;
+    m_file = fopen(path.c_str(), "r+b");
+    if(m_file == nullptr)
+    {
+        if(!create)
+            return false;
+        m_file = fopen(path.c_str(), "w+b");
+        if(m_file == nullptr)
+        {
+            fprintf(stderr, "[region] can't create %s\n", path.c_str());
+            return false;
+        }
+
+        memcpy(h.magic, regionMagic, 4);
+        h.version = REGIONFILE_VERSION;
+        h.width = Chunk::WIDTH;
+        h.height = Chunk::HEIGHT;
+        h.depth = Chunk::DEPTH;
+        h.worldHeight = WORLD_HEIGHT;
+
+        std::vector<uint8_t> header(HEADER_SECTORS * REGIONFILE_SECTOR, 0);
+        memcpy(header.data(), &h, sizeof(h));
+        if(fwrite(header.data(), 1, header.size(), m_file) != header.size() || fflush(m_file) != 0)
+        {
+            fprintf(stderr, "[region] can't write %s\n", path.c_str());
+            fclose(m_file);
+            m_file = nullptr;
+            return false;
+        }
+        m_fileSize = header.size();
+        return true;
+    }
+
+    const bool ok = fread(&h, sizeof(h), 1, m_file) == 1 &&
+                    fread(m_table.data(), sizeof(uint32_t), CHUNKS, m_file) == (size_t)CHUNKS;
+    if(!ok || memcmp(h.magic, regionMagic, 4) != 0 || h.version < 1 || h.version > REGIONFILE_VERSION ||
+       h.width != Chunk::WIDTH || h.height != Chunk::HEIGHT || h.depth != Chunk::DEPTH || h.worldHeight != WORLD_HEIGHT)
+    {
+        fprintf(stderr, "[region] %s isn't a region file for this chunk size\n", path.c_str());
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    if(h.version < REGIONFILE_VERSION)
+    {
+        if(COUNT_BITS != 8)
+        {
+            // entries of older files have an 8-bit count, on disk before the version says otherwise
+            for(uint32_t &e : m_table)
+                e = makeEntry(e >> 8, e & 0xff);
+            fseek(m_file, TABLE_OFFSET, SEEK_SET);
+            if(fwrite(m_table.data(), sizeof(uint32_t), CHUNKS, m_file) != (size_t)CHUNKS || !MappedFile::sync(m_file))
+            {
+                fprintf(stderr, "[region] can't convert %s\n", path.c_str());
+                fclose(m_file);
+                m_file = nullptr;
+                return false;
+            }
+        }
+        // palette records may follow, older readers must not take them for corrupt ones
+        const uint32_t version = REGIONFILE_VERSION;
+        fseek(m_file, offsetof(Header, version), SEEK_SET);
+        fwrite(&version, sizeof(version), 1, m_file);
+        fflush(m_file);
+    }
+
+    fseek(m_file, 0, SEEK_END);
+    m_fileSize = ftell(m_file);
+    const size_t fileSectors = sectors(m_fileSize);
+    for(uint32_t &e : m_table)
+    {
+        const uint32_t first = entryFirst(e), count = entryCount(e);
+        if(e == 0)
+            continue;
+        if(first < HEADER_SECTORS || count == 0 || first + count > fileSectors)
+        {
+            fprintf(stderr, "[region] %s: dropping an entry past the end of the file\n", path.c_str());
+            e = 0;
+            continue;
+        }
+        if(m_used.size() < first + count)
+            m_used.resize(first + count, false);
+        std::fill(m_used.begin() + first, m_used.begin() + first + count, true);
+    }
+    return true;
+}
+
+void RegionFile::close()
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    if(m_file != nullptr)
+    {
+        commit();
+        fclose(m_file);
+    }
+    m_file = nullptr;
+    m_fileSize = 0;
+    m_pendingSlots.clear();
+    m_replaced.clear();
+    m_maps.clear(); // borrowers keep theirs
+}
+
+bool RegionFile::sync()
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_file == nullptr || commit();
+}
+
+bool RegionFile::commit()
+{
+    // the records first, so no entry on disk ever points at one that isn't there
+    if(!MappedFile::sync(m_file))
+        return false;
+    bool ok = true;
+    for(int s : m_pendingSlots)
+    {
+        ok = ok && fseek(m_file, TABLE_OFFSET + s*sizeof(uint32_t), SEEK_SET) == 0 &&
+             fwrite(&m_table[s], sizeof(uint32_t), 1, m_file) == 1;
+    }
+    if(!ok || !MappedFile::sync(m_file))
+        return false; // entries stay pending, the old records stay allocated
+
+    // nothing on disk refers to the replaced records any more
+    for(uint32_t e : m_replaced)
+        release(e);
+    m_pendingSlots.clear();
+    m_replaced.clear();
+    return true;
+}
+
+bool RegionFile::has(const glm::ivec3 &cpos) const
+{
+    if(cpos.y < 0 || cpos.y >= Chunk::COLUMN_HEIGHT)
+        return false;
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_file != nullptr && m_table[slot(cpos)] != 0;
+}
+
+size_t RegionFile::sectorsUsed() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return std::count(m_used.begin(), m_used.end(), true);
+}
+
+bool RegionFile::pinned() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return borrowed();
+}
+
+bool RegionFile::borrowed() const
+{
+    // new references are only taken under m_lock, so a count of 1 can't go up behind our back
+    return std::any_of(m_maps.begin(), m_maps.end(),
+                       [](const std::shared_ptr<MappedFile> &m) { return m.use_count() > 1; });
+}
+
+std::shared_ptr<MappedFile> RegionFile::mapping(uint64_t end)
+{
+    if(!m_maps.empty() && m_maps.back()->size() >= end)
+        return m_maps.back();
+
+    // the file grew since it was mapped
+    m_maps.erase(std::remove_if(m_maps.begin(), m_maps.end(),
+                                [](const std::shared_ptr<MappedFile> &m) { return m.use_count() == 1; }),
+                 m_maps.end());
+    std::shared_ptr<MappedFile> map = std::make_shared<MappedFile>();
+    if(!map->open(m_path) || map->size() < end)
+    {
+        fprintf(stderr, "[region] can't map %s\n", m_path.c_str());
+        return nullptr;
+    }
+    m_maps.push_back(map);
+    return map;
+}
+
+uint32_t RegionFile::allocate(uint32_t count, bool append)
+{
+    // first fit, or grow the file
+    uint32_t run = 0;
+    for(uint32_t i = HEADER_SECTORS; !append && i < m_used.size(); i++)
+    {
+        run = m_used[i] ? 0 : run + 1;
+        if(run == count)
+        {
+            const uint32_t first = i + 1 - count;
+            std::fill(m_used.begin() + first, m_used.begin() + first + count, true);
+            return first;
+        }
+    }
+    // a pinned file grows past everything that may be mapped
+    const uint32_t first = append ? std::max<uint32_t>(m_used.size(), sectors(m_fileSize)) : m_used.size() - run;
+    m_used.resize(first + count, false);
+    std::fill(m_used.begin() + first, m_used.end(), true);
+    return first;
+}
+
+void RegionFile::release(uint32_t entry)
+{
+    const uint32_t first = entryFirst(entry), count = entryCount(entry);
+    if(entry != 0)
+        std::fill(m_used.begin() + first, m_used.begin() + first + count, false);
+}
+
+Chunk *RegionFile::load(const glm::ivec3 &cpos, bool &mapped)
+{
+    mapped = false;
+    if(cpos.y < 0 || cpos.y >= Chunk::COLUMN_HEIGHT)
+        return nullptr;
+
+    std::shared_ptr<MappedFile> map;
+    size_t offset, size;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        const uint32_t e = (m_file != nullptr) ? m_table[slot(cpos)] : 0;
+        if(e == 0)
+            return nullptr;
+
+        // the last record may end inside its last sector
+        offset = (size_t)entryFirst(e) * REGIONFILE_SECTOR;
+        size = std::min<uint64_t>(entryCount(e) * REGIONFILE_SECTOR, m_fileSize - offset);
+        map = mapping(offset + size);
+    }
+    if(map == nullptr)
+        return nullptr;
+
+    // the bytes can't change while we hold the mapping, writes append instead
+    Chunk *ch = decode(cpos, map->data() + offset, size, map, mapped);
+    if(ch == nullptr)
+        fprintf(stderr, "[region] corrupt chunk %d %d %d\n", cpos.x, cpos.y, cpos.z);
+    return ch;
+}
+
+Chunk *RegionFile::decode(const glm::ivec3 &cpos, const uint8_t *record, size_t size,
+                          const std::shared_ptr<MappedFile> &map, bool &mapped)
+{
+    uint32_t length, crc;
+    if(size < RECORD_HEADER)
+        return nullptr;
+    memcpy(&length, record, 4);
+    const uint8_t compression = record[4];
+    memcpy(&crc, record + 5, 4);
+    if(length > size - RECORD_HEADER)
+        return nullptr;
+
+    const uint8_t *payload = record + RECORD_HEADER;
+    if(compression == COMPRESS_PALETTE)
+    {
+        const size_t end = RECORD_HEADER + length;
+        if(end < PALETTE_ENTRIES || crc32(0, payload, length) != crc)
+            return nullptr;
+
+        uint16_t count, live;
+        const int bits = record[PALETTE_META];
+        memcpy(&count, record + PALETTE_META + 2, 2);
+        memcpy(&live, record + PALETTE_META + 4, 2);
+        const size_t wordsAt = paletteWordsAt(count);
+        if(bits > 16 || wordsAt + PalettedStorage<Chunk::VOLUME>::wordCount(bits)*sizeof(uint64_t) > end)
+            return nullptr;
+
+        Chunk *ch = Chunk::fromPalette(cpos, bits, count, live, (const uint16_t*)(record + PALETTE_ENTRIES),
+                                       (const uint64_t*)(record + wordsAt), map);
+        mapped = ch != nullptr;
+        return ch;
+    }
+
+    uint16_t blocks[Chunk::VOLUME];
+    bool ok;
+    if(compression == COMPRESS_ZLIB)
+    {
+        uLongf out = BLOCK_BYTES;
+        ok = uncompress((Bytef*)blocks, &out, payload, length) == Z_OK && out == BLOCK_BYTES;
+    }
+    else
+    {
+        ok = compression == COMPRESS_NONE && length == BLOCK_BYTES;
+        if(ok)
+            memcpy(blocks, payload, BLOCK_BYTES);
+    }
+    if(!ok || crc32(0, (const Bytef*)blocks, BLOCK_BYTES) != crc)
+        return nullptr;
+    return Chunk::fromBlocks(cpos, blocks);
+}
+
+void RegionFile::encode(const Chunk *ch, std::vector<uint8_t> &record)
+{
+    // palette layout first, it's what a mapped load can use directly
+    const PalettedStorage<Chunk::VOLUME> &s = ch->storage();
+    const int count = s.paletteCount();
+    const size_t wordsAt = paletteWordsAt(count);
+    const size_t wordBytes = PalettedStorage<Chunk::VOLUME>::wordCount(s.bits()) * sizeof(uint64_t);
+    record.assign(wordsAt + wordBytes, 0);
+    record[PALETTE_META] = s.bits();
+    const uint16_t count16 = count, live16 = s.paletteSize();
+    memcpy(record.data() + PALETTE_META + 2, &count16, 2);
+    memcpy(record.data() + PALETTE_META + 4, &live16, 2);
+    memcpy(record.data() + PALETTE_ENTRIES, s.palette(), count*sizeof(uint16_t));
+    memcpy(record.data() + wordsAt, s.words(), wordBytes);
+    const uint32_t paletteSectors = sectors(record.size());
+    if(paletteSectors <= 1)
+    {
+        finishRecord(record, COMPRESS_PALETTE, crc32(0, record.data() + RECORD_HEADER, record.size() - RECORD_HEADER));
+        return;
+    }
+
+    uint16_t blocks[Chunk::VOLUME];
+    for(int i=0; i < Chunk::VOLUME; i++)
+        blocks[i] = ch->getBlockAt(i);
+
+    std::vector<uint8_t> packed(RECORD_HEADER + compressBound(BLOCK_BYTES));
+    uLongf length = packed.size() - RECORD_HEADER;
+    uint8_t compression = COMPRESS_ZLIB;
+    if(compress2(packed.data() + RECORD_HEADER, &length, (const Bytef*)blocks, BLOCK_BYTES, Z_BEST_SPEED) != Z_OK ||
+       length >= BLOCK_BYTES)
+    {
+        compression = COMPRESS_NONE;
+        length = BLOCK_BYTES;
+        memcpy(packed.data() + RECORD_HEADER, blocks, BLOCK_BYTES);
+    }
+    packed.resize(RECORD_HEADER + length);
+
+    if(paletteSectors <= sectors(packed.size()) * REGIONFILE_MAP_RATIO)
+    {
+        finishRecord(record, COMPRESS_PALETTE, crc32(0, record.data() + RECORD_HEADER, record.size() - RECORD_HEADER));
+        return;
+    }
+    record.swap(packed);
+    finishRecord(record, compression, crc32(0, (const Bytef*)blocks, BLOCK_BYTES));
+}
+
+bool RegionFile::write(const Chunk *ch)
+{
+    const glm::ivec3 &cpos = ch->getPos();
+    if(cpos.y < 0 || cpos.y >= Chunk::COLUMN_HEIGHT)
+        return false;
+
+    // encoded outside the lock
+    std::vector<uint8_t> record;
+    encode(ch, record);
+    const uint32_t count = sectors(record.size());
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    if(m_file == nullptr)
+        return false;
+
+    const bool pinned = borrowed();
+    if(!pinned)
+        m_maps.clear(); // nobody reads them, and they may not see what we overwrite
+
+    // never over the last good copy, a torn write leaves the old record and entry as they were
+    const int s = slot(cpos);
+    const uint32_t old = m_table[s];
+    const uint32_t first = allocate(count, pinned);
+    const uint32_t entry = makeEntry(first, count);
+    const bool ok = fseek(m_file, (long)first * REGIONFILE_SECTOR, SEEK_SET) == 0 &&
+                    fwrite(record.data(), 1, record.size(), m_file) == record.size() &&
+                    fflush(m_file) == 0;
+    if(!ok)
+    {
+        fprintf(stderr, "[region] can't write chunk %d %d %d\n", cpos.x, cpos.y, cpos.z);
+        release(entry);
+        return false;
+    }
+
+    // the entry on disk follows at the next sync, the old record stays allocated until then
+    m_fileSize = std::max<uint64_t>(m_fileSize, (uint64_t)first * REGIONFILE_SECTOR + record.size());
+    m_pendingSlots.push_back(s);
+    if(old != 0)
+        m_replaced.push_back(old);
+    m_table[s] = entry;
+    return true;
+}
+
+size_t RegionFile::prefetch(const glm::ivec2 &column)
+{
+    std::shared_ptr<MappedFile> map;
+    uint32_t entries[Chunk::COLUMN_HEIGHT];
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        if(m_file == nullptr)
+            return 0;
+        const int s = slot(glm::ivec3(column.x, 0, column.y));
+        std::copy(m_table.begin() + s, m_table.begin() + s + Chunk::COLUMN_HEIGHT, entries);
+        if(std::none_of(entries, entries + Chunk::COLUMN_HEIGHT, [](uint32_t e) { return e != 0; }))
+            return 0;
+        map = mapping(m_fileSize);
+    }
+    if(map == nullptr)
+        return 0;
+
+    size_t count = 0;
+    for(uint32_t e : entries)
+    {
+        if(e == 0)
+            continue;
+        map->prefetch((size_t)entryFirst(e) * REGIONFILE_SECTOR, entryCount(e) * REGIONFILE_SECTOR);
+        count++;
+    }
+    return count;
+}
+
+RegionStorage::RegionStorage(const std::string &dir)
+    : m_dir(dir), m_useCounter(0), m_saved(0), m_loaded(0), m_failed(0), m_bytesWritten(0), m_bytesRead(0),
+      m_mapped(0), m_prefetched(0), m_minorFaults(0), m_majorFaults(0), m_loadNs(0), m_maxLoadNs(0)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_dir, ec);
+    if(ec)
+        fprintf(stderr, "[region] can't create %s: %s\n", m_dir.c_str(), ec.message().c_str());
+}
+
+const std::string &RegionStorage::directory() const
+{
+    return m_dir;
+}
+
+RegionStorage::Stats RegionStorage::stats() const
+{
+    Stats s;
+    s.saved = m_saved.load();
+    s.loaded = m_loaded.load();
+    s.failed = m_failed.load();
+    s.bytesWritten = m_bytesWritten.load();
+    s.bytesRead = m_bytesRead.load();
+    s.mapped = m_mapped.load();
+    s.promoted = PalettedStorage<Chunk::VOLUME>::promotions();
+    s.prefetched = m_prefetched.load();
+    s.minorFaults = m_minorFaults.load();
+    s.majorFaults = m_majorFaults.load();
+    s.avgLoadUs = s.loaded ? m_loadNs.load() * 1e-3 / s.loaded : 0.0;
+    s.maxLoadUs = m_maxLoadNs.load() * 1e-3;
+    return s;
+}
+
+std::shared_ptr<RegionFile> RegionStorage::file(const glm::ivec3 &cpos, bool create)
+{
+    const glm::ivec2 rpos(cpos.x >> REGIONFILE_SHIFT, cpos.z >> REGIONFILE_SHIFT);
+    const uint64_t key = ((uint64_t)(uint32_t)rpos.x << 32) | (uint32_t)rpos.y;
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    auto it = m_files.find(key);
+    if(it != m_files.end())
+    {
+        it->second.lastUse = ++m_useCounter;
+        if(it->second.file != nullptr || !create)
+            return it->second.file;
+    }
+    else if(m_files.size() >= REGIONFILE_OPEN)
+    {
+        // files in use or pinned stay open, a second instance for the same path would
+        // allocate sectors behind the first one's back
+        auto lru = m_files.end();
+        for(auto f = m_files.begin(); f != m_files.end(); ++f)
+        {
+            const std::shared_ptr<RegionFile> &rf = f->second.file;
+            if((rf == nullptr || (rf.use_count() == 1 && !rf->pinned())) &&
+               (lru == m_files.end() || f->second.lastUse < lru->second.lastUse))
+                lru = f;
+        }
+        if(lru != m_files.end())
+            m_files.erase(lru);
+    }
+
+    // misses are remembered too, so unsaved areas don't hit the filesystem
+    std::shared_ptr<RegionFile> f = std::make_shared<RegionFile>();
+    const std::string path = m_dir + "/r." + std::to_string(rpos.x) + "." + std::to_string(rpos.y) + ".scr";
+    if(!f->open(path, create))
+        f = nullptr;
+    Entry &e = m_files[key];
+    e.file = f;
+    e.lastUse = ++m_useCounter;
+    return f;
+}
+
+bool RegionStorage::save(const Chunk *ch)
+{
+    std::shared_ptr<RegionFile> f = file(ch->getPos(), true);
+    if(f == nullptr || !f->write(ch))
+    {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_saved.fetch_add(1, std::memory_order_relaxed);
+    m_bytesWritten.fetch_add(BLOCK_BYTES, std::memory_order_relaxed);
+    return true;
+}
+
+bool RegionStorage::sync()
+{
+    std::vector<std::shared_ptr<RegionFile>> files;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        for(auto &p : m_files)
+        {
+            if(p.second.file != nullptr)
+                files.push_back(p.second.file);
+        }
+    }
+    bool ok = true;
+    for(const std::shared_ptr<RegionFile> &f : files)
+        ok = f->sync() && ok;
+    return ok;
+}
+
+bool RegionStorage::contains(const glm::ivec3 &cpos)
+{
+    std::shared_ptr<RegionFile> f = file(cpos, false);
+    return f != nullptr && f->has(cpos);
+}
+
+Chunk *RegionStorage::load(const glm::ivec3 &cpos)
+{
+    std::shared_ptr<RegionFile> f = file(cpos, false);
+    if(f == nullptr || !f->has(cpos))
+        return nullptr;
+
+    size_t minor0, major0, minor1, major1;
+    MappedFile::threadFaults(minor0, major0);
+    const auto t = std::chrono::steady_clock::now();
+
+    bool mapped;
+    Chunk *ch = f->load(cpos, mapped);
+
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+    MappedFile::threadFaults(minor1, major1);
+    m_minorFaults.fetch_add(minor1 - minor0, std::memory_order_relaxed);
+    m_majorFaults.fetch_add(major1 - major0, std::memory_order_relaxed);
+    if(ch == nullptr)
+    {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    m_loaded.fetch_add(1, std::memory_order_relaxed);
+    if(mapped)
+        m_mapped.fetch_add(1, std::memory_order_relaxed);
+    m_bytesRead.fetch_add(BLOCK_BYTES, std::memory_order_relaxed);
+    m_loadNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t peak = m_maxLoadNs.load(std::memory_order_relaxed);
+    while(ns > peak && !m_maxLoadNs.compare_exchange_weak(peak, ns, std::memory_order_relaxed))
+        ;
+    return ch;
+}
+
+void RegionStorage::prefetch(const glm::ivec2 &column, const glm::ivec2 &step, int radius)
+{
+    if(step == glm::ivec2(0))
+        return;
+
+    // the ring the streamer asks for next, on the side we're heading to
+    const int outer = radius + REGIONFILE_PREFETCH;
+    size_t count = 0;
+    for(int dx = -outer; dx <= outer; dx++)
+    {
+        for(int dz = -outer; dz <= outer; dz++)
+        {
+            const int d2 = dx*dx + dz*dz;
+            if(d2 <= radius*radius || d2 > outer*outer || dx*step.x + dz*step.y <= 0)
+                continue;
+            const glm::ivec2 c = column + glm::ivec2(dx, dz);
+            std::shared_ptr<RegionFile> f = file(glm::ivec3(c.x, 0, c.y), false);
+            if(f != nullptr)
+                count += f->prefetch(c);
+        }
+    }
+    m_prefetched.fetch_add(count, std::memory_order_relaxed);
+}
@@ -0,0 +1,153 @@
+#ifndef REGIONFILE_HPP
+#define REGIONFILE_HPP
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.hpp"
+#include "mappedfile.hpp"
+
+#define REGIONFILE_SHIFT (5)         // region files hold 32x32 chunk columns
+#define REGIONFILE_COLUMNS (1 << REGIONFILE_SHIFT)
+#define REGIONFILE_SECTOR (64)       // allocation unit in bytes, sized for small chunks
+#define REGIONFILE_VERSION (3)      // 3 sized the entry count for the chunk size, 2 added palette records, older files are upgraded on open
+#define REGIONFILE_OPEN (32)         // region files kept open
+#define REGIONFILE_MAP_RATIO (2)     // palette records may take this many times the sectors of zlib ones
+#define REGIONFILE_PREFETCH (2)      // columns past the stream radius advised ahead of the player
+
+// Saved chunks of a 32x32 column area in one file.
+// The header holds one entry per chunk: first sector and sector count of its
+// record, 0 if the chunk was never saved; the count takes as many bits as the
+// largest record of this chunk size needs, 8 for small chunks. A record is a length, compression
+// type, CRC-32 of the uncompressed payload and the payload. A rewrite always
+// goes to free sectors or the end of the file. sync() makes the new records
+// durable, only then writes and syncs their entries, and only after that
+// frees the sectors of the records they replaced, so a crash at any point
+// leaves every entry on disk pointing at an intact record.
+//
+// Records are read through a MappedFile. Palette records hold the chunk's
+// palette and index words as laid out in memory, so a loaded chunk borrows
+// them from the mapping until its first change. While any borrower is alive
+// the file is pinned: rewrites always append, mapped bytes never change, and
+// the sectors they leave behind are reused once nothing borrows them.
+class RegionFile
+{
+public:
+    enum Compression : uint8_t { COMPRESS_NONE, COMPRESS_ZLIB, COMPRESS_PALETTE };
+
+    static constexpr int CHUNKS = REGIONFILE_COLUMNS * REGIONFILE_COLUMNS * Chunk::COLUMN_HEIGHT;
+
+    RegionFile();
+    ~RegionFile();
+
+    RegionFile(const RegionFile&) = delete;
+    RegionFile &operator=(const RegionFile&) = delete;
+
+    // creates the file if create is set, false if it's missing or from another format
+    bool open(const std::string &path, bool create);
+    void close(); // syncs first
+    // forces written records to disk, then their entries
+    bool sync();
+
+    bool has(const glm::ivec3 &cpos) const;
+    // chunk from the pool, nullptr if absent or corrupt; mapped is set if it borrows the mapping
+    Chunk *load(const glm::ivec3 &cpos, bool &mapped);
+    bool write(const Chunk *ch);
+    // advises the records of a column, returns how many
+    size_t prefetch(const glm::ivec2 &column);
+
+    // sectors holding live records, the header included
+    size_t sectorsUsed() const;
+    // a loaded chunk still borrows the mapping
+    bool pinned() const;
+
+    static int slot(const glm::ivec3 &cpos);
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint16_t width, height, depth, worldHeight;
+    };
+
+    static constexpr size_t TABLE_OFFSET = sizeof(Header);
+    static constexpr uint32_t HEADER_SECTORS = (sizeof(Header) + CHUNKS*sizeof(uint32_t) + REGIONFILE_SECTOR - 1) / REGIONFILE_SECTOR;
+
+    // these expect m_lock held
+    uint32_t allocate(uint32_t count, bool append);
+    void release(uint32_t entry);
+    bool commit();
+    std::shared_ptr<MappedFile> mapping(uint64_t end);
+    bool borrowed() const;
+
+    static void encode(const Chunk *ch, std::vector<uint8_t> &record);
+    static Chunk *decode(const glm::ivec3 &cpos, const uint8_t *record, size_t size,
+                         const std::shared_ptr<MappedFile> &map, bool &mapped);
+
+    FILE *m_file;
+    std::string m_path;
+    uint64_t m_fileSize;
+    std::vector<uint32_t> m_table; // first sector above a count of sectors
+    std::vector<bool> m_used;      // per sector
+    std::vector<int> m_pendingSlots;  // entries changed since the last sync
+    std::vector<uint32_t> m_replaced; // records the table on disk still points at
+    // newest last, older ones stay while chunks borrow from them
+    std::vector<std::shared_ptr<MappedFile>> m_maps;
+    mutable std::mutex m_lock;
+};
+
+// Region files of one world, opened on demand.
+class RegionStorage
+{
+public:
+    struct Stats
+    {
+        size_t saved, loaded, failed;
+        size_t bytesWritten, bytesRead; // uncompressed block data
+        size_t mapped;     // loads borrowing the file mapping
+        size_t promoted;   // borrowed chunks copied on a change, process-wide
+        size_t prefetched; // records advised ahead of the player
+        size_t minorFaults, majorFaults; // taken by loads
+        double avgLoadUs, maxLoadUs;
+    };
+
+    explicit RegionStorage(const std::string &dir);
+
+    // writes the chunk's blocks, the chunk isn't marked saved
+    bool save(const Chunk *ch);
+    // chunk from the pool with the saved blocks, nullptr if it was never saved
+    Chunk *load(const glm::ivec3 &cpos);
+    bool contains(const glm::ivec3 &cpos);
+    // forces everything saved so far to disk, closed files were synced on close
+    bool sync();
+    // advises saved columns just outside radius in the direction of step, call when the player changes column
+    void prefetch(const glm::ivec2 &column, const glm::ivec2 &step, int radius);
+
+    Stats stats() const;
+    const std::string &directory() const;
+private:
+    std::shared_ptr<RegionFile> file(const glm::ivec3 &cpos, bool create);
+
+    std::string m_dir;
+
+    std::mutex m_lock;
+    struct Entry
+    {
+        std::shared_ptr<RegionFile> file; // nullptr: no file on disk
+        uint64_t lastUse;
+    };
+    std::unordered_map<uint64_t, Entry> m_files;
+    uint64_t m_useCounter;
+
+    std::atomic<size_t> m_saved, m_loaded, m_failed, m_bytesWritten, m_bytesRead;
+    std::atomic<size_t> m_mapped, m_prefetched, m_minorFaults, m_majorFaults;
+    std::atomic<uint64_t> m_loadNs, m_maxLoadNs;
+};
+
+#endif // REGIONFILE_HPP
@@ -0,0 +1,122 @@
+#include "residency.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+ChunkResidency::ChunkResidency(ChunkStore &store)
+    : m_store(store), m_budget(RESIDENCY_BUDGET), m_radius(RESIDENCY_RADIUS),
+      m_stats{0, 0, 0, 0, 0}
+{
+
+}
+
+void ChunkResidency::setBudget(size_t bytes)
+{
+    m_budget = bytes;
+}
+
+void ChunkResidency::setViewRadius(int columns)
+{
+    m_radius = columns;
+}
+
+void ChunkResidency::setSaveHook(const SaveHook &hook)
+{
+    m_saveHook = hook;
+}
+
+void ChunkResidency::update(const glm::ivec3 &center)
+{
+    struct Column
+    {
+        uint64_t lastAccess = 0;
+        size_t bytes = 0;
+        bool modified = false;
+        std::vector<Chunk*> chunks;
+    };
+    std::unordered_map<uint64_t, Column> columns;
+    size_t bytes = 0;
+    m_store.forEach([&](Chunk *ch)
+    {
+        const size_t sz = ch->memoryUsage();
+        bytes += sz;
+
+        const glm::ivec3 &p = ch->getPos();
+        const int dx = p.x - center.x, dz = p.z - center.z;
+        if(dx*dx + dz*dz <= m_radius*m_radius)
+            return;
+        Column &col = columns[((uint64_t)(uint32_t)p.x << 32) | (uint32_t)p.z];
+        col.lastAccess = std::max(col.lastAccess, ch->lastAccessTick());
+        col.bytes += sz;
+        col.modified = col.modified || ch->isModified();
+        col.chunks.push_back(ch);
+    });
+
+    m_stats.resident = m_store.size();
+    m_stats.residentBytes = bytes;
+    if(bytes <= m_budget)
+        return;
+
+    std::vector<Column*> candidates;
+    for(auto &c : columns)
+    {
+        if(!c.second.modified || m_saveHook)
+            candidates.push_back(&c.second);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Column *a, const Column *b)
+    {
+        return a->lastAccess < b->lastAccess;
+    });
+
+    for(Column *col : candidates)
+    {
+        if(bytes <= m_budget)
+            break;
+
+        // the saver still reads these
+        if(std::any_of(col->chunks.begin(), col->chunks.end(),
+                       [](const Chunk *ch) { return ch->snapshotState() != Chunk::SNAPSHOT_NONE; }))
+            continue;
+
+        if(col->modified)
+        {
+            bool saved = true;
+            for(Chunk *ch : col->chunks)
+            {
+                if(ch->isModified() && !m_saveHook(ch))
+                {
+                    saved = false;
+                    break;
+                }
+            }
+            if(!saved)
+                continue;
+            for(Chunk *ch : col->chunks)
+            {
+                if(ch->isModified())
+                {
+                    ch->markSaved();
+                    m_stats.saved++;
+                }
+            }
+        }
+
+        for(Chunk *ch : col->chunks)
+        {
+            if(Chunk *old = m_store.remove(ch->getPos()))
+                ChunkStore::retire(old);
+        }
+        bytes -= col->bytes;
+        m_stats.evicted += col->chunks.size();
+        m_stats.evictedBytes += col->bytes;
+    }
+
+    m_stats.resident = m_store.size();
+    m_stats.residentBytes = bytes;
+}
+
+const ChunkResidency::Stats &ChunkResidency::stats() const
+{
+    return m_stats;
+}
@@ -0,0 +1,49 @@
+#ifndef RESIDENCY_HPP
+#define RESIDENCY_HPP
+
+#include <functional>
+#include <cstddef>
+
+#include "chunkstore.hpp"
+
+// default limits
+#define RESIDENCY_BUDGET (256u << 20) // bytes
+#define RESIDENCY_RADIUS (8)          // columns, never evicted inside; the streamer's radius
+
+// Keeps resident chunk memory under a budget by evicting the least recently
+// touched columns outside the view radius, measured on xz like the streamer
+// does. Columns go whole: the streamer regenerates any column missing a chunk.
+// Modified chunks go through the save hook first; without a hook, or if it
+// returns false, their column stays resident. So does a column with a chunk
+// held by a snapshot until the snapshot is written.
+class ChunkResidency
+{
+public:
+    struct Stats
+    {
+        size_t resident, residentBytes;
+        size_t evicted, evictedBytes; // totals since start
+        size_t saved;
+    };
+    typedef std::function<bool(Chunk*)> SaveHook;
+
+    ChunkResidency(ChunkStore &store);
+
+    void setBudget(size_t bytes);
+    void setViewRadius(int columns);
+    void setSaveHook(const SaveHook &hook);
+
+    // call from inside an EpochGuard
+    void update(const glm::ivec3 &center);
+
+    const Stats &stats() const;
+private:
+    ChunkStore &m_store;
+    size_t m_budget;
+    int m_radius;
+    SaveHook m_saveHook;
+
+    Stats m_stats;
+};
+
+#endif // RESIDENCY_HPP
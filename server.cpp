@@ -164,3 +164,8 @@ uint16_t Server::getPID() const
 {
     return m_selfPID;
 }
+
+Biome Server::getBiome(int x, int z)
+{
+    return BiomeMap::shared(GameWindow::m_seed)->biomeAt(x, z);
+}
@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <list>
 
+#include "biome.hpp"
+
 uint16_t checksum(void *addr, int count);
 
 struct PlayerInfo;
@@ -23,6 +25,9 @@ public:
 
     uint16_t getPID() const;
 
+    // biome at a world block column for the current seed, from the cached biome map
+    static Biome getBiome(int x, int z);
+
     static Server *serverInstance;
 private:
     kissnet::tcp_socket *m_socket;
@@ -3,13 +3,30 @@
 #include <cassert>
 #include <glm/gtc/type_ptr.hpp>
 
+namespace
+{
+    void addDefines(std::string &source, const std::string &defines)
+    {
+        if(defines.empty())
+            return;
+        size_t at = 0;
+        if(source.compare(0, 8, "#version") == 0)
+        {
+            at = source.find('\n');
+            at = (at == std::string::npos) ? source.size() : at + 1;
+        }
+        source.insert(at, defines);
+    }
+}
+
 Shader::Shader()
     : Shader("", "", "")
 {
 
 }
 
-Shader::Shader(const std::string &v_path, const std::string &f_path, const std::string &g_path)
+Shader::Shader(const std::string &v_path, const std::string &f_path, const std::string &g_path,
+               const std::string &defines)
 {
     if(v_path.length() == 0 || f_path.length() == 0)
     {
@@ -40,6 +57,11 @@ Shader::Shader(const std::string &v_path, const std::string &f_path, const std::
         fin.close();
     }
 
+    addDefines(vsh_source, defines);
+    addDefines(fsh_source, defines);
+    if(load_geom)
+        addDefines(gsh_source, defines);
+
     // load shaders to memory
     GLuint vsh, fsh, gsh;
     vsh = glCreateShader(GL_VERTEX_SHADER);
@@ -160,15 +182,15 @@ Shader *ShaderManager::get(const std::string &id) const
     return nullptr;
 }
 
-void ShaderManager::loadShader(const std::vector<std::string> &paths, const std::string &id)
+void ShaderManager::loadShader(const std::vector<std::string> &paths, const std::string &id, const std::string &defines)
 {
     assert(m_shaders.find(id) == m_shaders.end() && "Shader duplicate");
     assert((paths.size() == 2 || paths.size() == 3) && "Invalid shader quantity");
 
     if(paths.size() == 2)
-        m_shaders[id] = new Shader(paths[0], paths[1]);
+        m_shaders[id] = new Shader(paths[0], paths[1], "", defines);
     else
-        m_shaders[id] = new Shader(paths[0], paths[1], paths[2]);
+        m_shaders[id] = new Shader(paths[0], paths[1], paths[2], defines);
 }
 
 
@@ -10,7 +10,9 @@ class Shader
 {
 public:
     Shader();
-    Shader(const std::string &v_path, const std::string &f_path, const std::string &g_path="");
+    // defines go right after each source's #version line
+    Shader(const std::string &v_path, const std::string &f_path, const std::string &g_path="",
+           const std::string &defines="");
     ~Shader();
 
     void use();
@@ -34,7 +36,7 @@ public:
 
     Shader *get(const std::string &id) const;
 
-    void loadShader(const std::vector<std::string> &paths, const std::string &id);
+    void loadShader(const std::vector<std::string> &paths, const std::string &id, const std::string &defines="");
 private:
     std::unordered_map<std::string, Shader*> m_shaders;
 };
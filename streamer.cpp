@@ -0,0 +1,129 @@
+#include "streamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ChunkStreamer::ChunkStreamer(ChunkStore &store, WorldGenerator &gen, JobSystem &jobs)
+    : m_store(store), m_gen(gen), m_jobs(jobs), m_radius(STREAM_RADIUS), m_maxInFlight(STREAM_MAX_IN_FLIGHT),
+      m_stats{0, 0, 0, 0, 0}, m_latencySum(0)
+{
+
+}
+
+void ChunkStreamer::setRadius(int columns)
+{
+    m_radius = columns;
+}
+
+void ChunkStreamer::setMaxInFlight(int columns)
+{
+    m_maxInFlight = columns;
+}
+
+uint64_t ChunkStreamer::columnKey(const glm::ivec2 &cpos)
+{
+    return ((uint64_t)(uint32_t)cpos.x << 32) | (uint32_t)cpos.y;
+}
+
+// a column counts as loaded only if none of its chunks were evicted
+bool ChunkStreamer::columnLoaded(const glm::ivec2 &cpos) const
+{
+    for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+    {
+        if(m_store.get(glm::ivec3(cpos.x, y, cpos.y)) == nullptr)
+            return false;
+    }
+    return true;
+}
+
+void ChunkStreamer::collectFinished()
+{
+    std::vector<std::pair<uint64_t, double>> done;
+    m_doneLock.lock();
+    done.swap(m_done);
+    m_doneLock.unlock();
+
+    for(const std::pair<uint64_t, double> &d : done)
+    {
+        m_inFlight.erase(d.first);
+        m_stats.generated++;
+        m_latencySum += d.second;
+        m_stats.maxLatencyMs = std::max(m_stats.maxLatencyMs, d.second);
+    }
+    if(m_stats.generated > 0)
+        m_stats.avgLatencyMs = m_latencySum / m_stats.generated;
+    m_stats.inFlight = m_inFlight.size();
+}
+
+void ChunkStreamer::update(const glm::vec3 &camPos, const glm::vec3 &camDir)
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    collectFinished();
+
+    const glm::ivec3 cc = Chunk::toChunkPos(glm::ivec3(glm::floor(camPos)));
+    const glm::ivec2 center(cc.x, cc.z);
+
+    glm::vec2 dir(camDir.x, camDir.z);
+    const float len = glm::length(dir);
+    dir = (len > 1e-4f) ? dir / len : glm::vec2(0.f);
+
+    // missing columns inside the radius, cheaper when closer and in front
+    std::vector<std::pair<float, glm::ivec2>> wanted;
+    for(int dx = -m_radius; dx <= m_radius; dx++)
+    {
+        for(int dz = -m_radius; dz <= m_radius; dz++)
+        {
+            const int d2 = dx*dx + dz*dz;
+            if(d2 > m_radius*m_radius)
+                continue;
+            const glm::ivec2 cpos = center + glm::ivec2(dx, dz);
+            if(m_inFlight.count(columnKey(cpos)) || columnLoaded(cpos))
+                continue;
+
+            const float facing = (d2 > 0) ? glm::dot(dir, glm::vec2(dx, dz)) / std::sqrt((float)d2) : 1.f;
+            wanted.push_back({d2 * (1.5f - 0.5f*facing), cpos});
+        }
+    }
+    std::sort(wanted.begin(), wanted.end(),
+              [](const std::pair<float, glm::ivec2> &a, const std::pair<float, glm::ivec2> &b)
+    {
+        return a.first < b.first;
+    });
+
+    size_t next = 0;
+    while(next < wanted.size() && (int)m_inFlight.size() < m_maxInFlight)
+    {
+        const glm::ivec2 cpos = wanted[next++].second;
+        const uint64_t key = columnKey(cpos);
+        const glm::ivec2 d = cpos - center;
+        const JobSystem::Priority prio = (d.x*d.x + d.y*d.y <= STREAM_SPAWN_RADIUS*STREAM_SPAWN_RADIUS) ?
+                                         JobSystem::HIGH : JobSystem::NORMAL;
+        const Clock::time_point queuedAt = Clock::now();
+
+        const JobSystem::Handle published = m_gen.request(cpos, prio);
+        m_inFlight[key] = m_jobs.submit([this, key, queuedAt]
+        {
+            const double ms = std::chrono::duration<double, std::milli>(Clock::now() - queuedAt).count();
+            std::lock_guard<std::mutex> dl(m_doneLock);
+            m_done.push_back({key, ms});
+        }, prio, {published});
+    }
+
+    m_stats.queued = wanted.size() - next;
+    m_stats.inFlight = m_inFlight.size();
+}
+
+void ChunkStreamer::reset()
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    for(auto &f : m_inFlight)
+        m_jobs.wait(f.second);
+    collectFinished();
+    m_stats.queued = 0;
+}
+
+ChunkStreamer::Stats ChunkStreamer::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_stats;
+}
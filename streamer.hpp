@@ -0,0 +1,66 @@
+#ifndef STREAMER_HPP
+#define STREAMER_HPP
+
+#include <glm/glm.hpp>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "chunkstore.hpp"
+#include "worldgen.hpp"
+
+// default limits, in columns
+#define STREAM_RADIUS (8)
+#define STREAM_SPAWN_RADIUS (2) // generated at high priority
+#define STREAM_MAX_IN_FLIGHT (64)
+
+// Requests missing columns around the camera from the world generator,
+// nearest and in-view first. Finished columns only fill empty slots, so loaded
+// or edited chunks are never overwritten and evicted ones simply come back.
+class ChunkStreamer
+{
+public:
+    struct Stats
+    {
+        size_t queued;   // missing columns waiting for a job slot
+        size_t inFlight;
+        size_t generated; // total
+        double avgLatencyMs, maxLatencyMs; // queue + generation time
+    };
+
+    ChunkStreamer(ChunkStore &store, WorldGenerator &gen, JobSystem &jobs);
+
+    void setRadius(int columns);
+    void setMaxInFlight(int columns);
+
+    // call once per frame from inside an EpochGuard
+    void update(const glm::vec3 &camPos, const glm::vec3 &camDir);
+    // waits for in-flight columns, call before dropping the world
+    void reset();
+
+    Stats stats() const;
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool columnLoaded(const glm::ivec2 &cpos) const;
+    void collectFinished();
+
+    static uint64_t columnKey(const glm::ivec2 &cpos);
+
+    ChunkStore &m_store;
+    WorldGenerator &m_gen;
+    JobSystem &m_jobs;
+    int m_radius, m_maxInFlight;
+
+    mutable std::mutex m_lock; // update() runs on the main loop, reset() may not
+    std::unordered_map<uint64_t, JobSystem::Handle> m_inFlight;
+    Stats m_stats;
+    double m_latencySum;
+
+    // written by jobs: column key, latency in ms
+    std::mutex m_doneLock;
+    std::vector<std::pair<uint64_t, double>> m_done;
+};
+
+#endif // STREAMER_HPP
@@ -0,0 +1,169 @@
+#include "terrain.hpp"
+#include "chunk.hpp"
+
+#include <algorithm>
+
+TerrainSampler::TerrainSampler(uint32_t seed, int stride, Filter filter)
+    : m_noise(seed), m_seed(seed), m_stride(std::max(stride, 1)), m_shift(0),
+      m_filter(filter), m_useCounter(0)
+{
+    while((1 << m_shift) < m_stride)
+        m_shift++;
+    m_stride = 1 << m_shift;
+    m_points = TERRAIN_TILE >> m_shift;
+
+    // octave o has period TERRAIN_SCALE/2^o blocks, lattice points sit on its zeros once
+    // that is a whole number of lattice steps
+    m_octaves = 0;
+    while(m_octaves < TERRAIN_OCTAVES && (m_stride << m_octaves) < TERRAIN_SCALE)
+        m_octaves++;
+}
+
+uint32_t TerrainSampler::seed() const
+{
+    return m_seed;
+}
+
+int TerrainSampler::stride() const
+{
+    return m_stride;
+}
+
+int TerrainSampler::octaves() const
+{
+    return m_octaves;
+}
+
+int TerrainSampler::toHeight(double noise)
+{
+    return 1 + (WORLD_HEIGHT-1) * (noise + 1.0) / 2.0;
+}
+
+uint64_t TerrainSampler::tileKey(const glm::ivec2 &tpos)
+{
+    return ((uint64_t)(uint32_t)tpos.x << 32) | (uint32_t)tpos.y;
+}
+
+double TerrainSampler::sampleExact(int x, int z) const
+{
+    return m_noise.octaveNoise2D<TERRAIN_OCTAVES>(x / (double)TERRAIN_SCALE, z / (double)TERRAIN_SCALE);
+}
+
+std::shared_ptr<TerrainSampler::Tile> TerrainSampler::buildTile(const glm::ivec2 &tpos) const
+{
+    const int n = m_points + 3;
+    std::vector<double> xs(n*n), zs(n*n);
+    for(int i=0; i < n; i++)
+    {
+        for(int j=0; j < n; j++)
+        {
+            xs[j + i*n] = (tpos.x*TERRAIN_TILE + (i-1)*m_stride) / (double)TERRAIN_SCALE;
+            zs[j + i*n] = (tpos.y*TERRAIN_TILE + (j-1)*m_stride) / (double)TERRAIN_SCALE;
+        }
+    }
+
+    std::shared_ptr<Tile> t = std::make_shared<Tile>();
+    t->values.resize(n*n);
+    t->lastUse = 0;
+    m_noise.accumulatedOctaveNoise2D(xs.data(), zs.data(), t->values.data(), n*n, m_octaves);
+    return t;
+}
+
+std::shared_ptr<const TerrainSampler::Tile> TerrainSampler::tile(const glm::ivec2 &tpos)
+{
+    const uint64_t key = tileKey(tpos);
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        auto it = m_tiles.find(key);
+        if(it != m_tiles.end())
+        {
+            it->second->lastUse = ++m_useCounter;
+            return it->second;
+        }
+    }
+
+    // built unlocked, a racing builder's tile wins and ours is dropped
+    std::shared_ptr<Tile> t = buildTile(tpos);
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    if(m_tiles.size() >= TERRAIN_CACHE_TILES)
+    {
+        auto lru = std::min_element(m_tiles.begin(), m_tiles.end(),
+                                    [](const auto &a, const auto &b) { return a.second->lastUse < b.second->lastUse; });
+        m_tiles.erase(lru);
+    }
+    auto res = m_tiles.emplace(key, t);
+    res.first->second->lastUse = ++m_useCounter;
+    return res.first->second;
+}
+
+namespace
+{
+    // Catmull-Rom through p1..p2
+    inline double cubic(double p0, double p1, double p2, double p3, double t)
+    {
+        return p1 + 0.5*t*(p2 - p0 + t*(2.0*p0 - 5.0*p1 + 4.0*p2 - p3 + t*(3.0*(p1 - p2) + p3 - p0)));
+    }
+}
+
+double TerrainSampler::sample(int x, int z)
+{
+    std::shared_ptr<const Tile> t = tile(glm::ivec2(x >> TERRAIN_TILE_SHIFT, z >> TERRAIN_TILE_SHIFT));
+    return interpolate(*t, x & (TERRAIN_TILE-1), z & (TERRAIN_TILE-1));
+}
+
+double TerrainSampler::interpolate(const Tile &t, int lx, int lz) const
+{
+    const int gi = (lx >> m_shift) + 1, gj = (lz >> m_shift) + 1; // +1 skips the apron
+    const double fx = (lx & (m_stride-1)) / (double)m_stride;
+    const double fz = (lz & (m_stride-1)) / (double)m_stride;
+    const int n = m_points + 3;
+    const double *v = t.values.data();
+    auto at = [&](int i, int j) { return v[j + i*n]; };
+
+    if(fx == 0.0 && fz == 0.0)
+        return at(gi, gj);
+
+    if(m_filter == BICUBIC)
+    {
+        double col[4];
+        for(int k=0; k < 4; k++)
+            col[k] = cubic(at(gi-1+k, gj-1), at(gi-1+k, gj), at(gi-1+k, gj+1), at(gi-1+k, gj+2), fz);
+        return cubic(col[0], col[1], col[2], col[3], fx);
+    }
+
+    const double a = at(gi, gj)   + fz*(at(gi, gj+1)   - at(gi, gj));
+    const double b = at(gi+1, gj) + fz*(at(gi+1, gj+1) - at(gi+1, gj));
+    return a + fx*(b - a);
+}
+
+void TerrainSampler::heightmap(const glm::ivec2 &column, int width, int depth, int *out)
+{
+    std::shared_ptr<const Tile> t;
+    glm::ivec2 tpos;
+    for(int i=0; i < width; i++)
+    {
+        for(int j=0; j < depth; j++)
+        {
+            const int x = column.x*width + i, z = column.y*depth + j;
+            const glm::ivec2 p(x >> TERRAIN_TILE_SHIFT, z >> TERRAIN_TILE_SHIFT);
+            if(t == nullptr || p != tpos)
+            {
+                t = tile(p);
+                tpos = p;
+            }
+            out[j + i*depth] = toHeight(interpolate(*t, x & (TERRAIN_TILE-1), z & (TERRAIN_TILE-1)));
+        }
+    }
+}
+
+std::shared_ptr<TerrainSampler> TerrainSampler::shared(uint32_t seed)
+{
+    static std::mutex lock;
+    static std::shared_ptr<TerrainSampler> current;
+
+    std::lock_guard<std::mutex> lk(lock);
+    if(current == nullptr || current->seed() != seed)
+        current = std::make_shared<TerrainSampler>(seed);
+    return current;
+}
@@ -0,0 +1,73 @@
+#ifndef TERRAIN_HPP
+#define TERRAIN_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "PerlinNoise.hpp"
+
+// heightmap noise: octave noise at (x, z) / TERRAIN_SCALE
+#define TERRAIN_SCALE (128)
+#define TERRAIN_OCTAVES (16)
+
+#define TERRAIN_STRIDE (4)        // lattice spacing in blocks, power of two
+#define TERRAIN_TILE_SHIFT (6)    // lattice tiles are 64x64 blocks
+#define TERRAIN_TILE (1 << TERRAIN_TILE_SHIFT)
+#define TERRAIN_CACHE_TILES (256)
+
+// Heightmap noise sampled on a coarse lattice and interpolated per block.
+// Lattice values are cached per tile and shared by every column in it.
+// Octaves with a period of one lattice step or less are zero on every
+// lattice point and are not evaluated; with stride 1 this is exact.
+class TerrainSampler
+{
+public:
+    enum Filter { BILINEAR, BICUBIC };
+
+    TerrainSampler(uint32_t seed, int stride = TERRAIN_STRIDE, Filter filter = BILINEAR);
+
+    // noise value at a world block column
+    double sample(int x, int z);
+    // reference, every octave evaluated at the block itself
+    double sampleExact(int x, int z) const;
+
+    // block heights for a chunk column, out[j + i*depth]
+    void heightmap(const glm::ivec2 &column, int width, int depth, int *out);
+
+    static int toHeight(double noise);
+
+    uint32_t seed() const;
+    int stride() const;
+    int octaves() const;
+
+    // sampler for the current world seed, replaced when the seed changes
+    static std::shared_ptr<TerrainSampler> shared(uint32_t seed);
+private:
+    struct Tile
+    {
+        std::vector<double> values; // (points+3)^2, one extra lattice point on each side
+        uint64_t lastUse;
+    };
+
+    std::shared_ptr<const Tile> tile(const glm::ivec2 &tpos);
+    double interpolate(const Tile &t, int lx, int lz) const;
+    std::shared_ptr<Tile> buildTile(const glm::ivec2 &tpos) const;
+
+    static uint64_t tileKey(const glm::ivec2 &tpos);
+
+    siv::PerlinNoise m_noise;
+    uint32_t m_seed;
+    int m_stride, m_shift, m_points; // lattice points per tile edge
+    int m_octaves;
+    Filter m_filter;
+
+    std::mutex m_lock;
+    std::unordered_map<uint64_t, std::shared_ptr<Tile>> m_tiles;
+    uint64_t m_useCounter;
+};
+
+#endif // TERRAIN_HPP
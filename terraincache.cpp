@@ -0,0 +1,365 @@
+#include "terraincache.hpp"
+#include "chunkpool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+static_assert(WORLD_HEIGHT <= 255, "cached heights are stored as bytes");
+
+namespace
+{
+    const char cacheMagic[4] = {'S', 'C', 'T', 'C'};
+
+    template<typename T>
+    inline void put(std::vector<uint8_t> &out, T v)
+    {
+        const size_t at = out.size();
+        out.resize(at + sizeof(T));
+        memcpy(out.data() + at, &v, sizeof(T));
+    }
+
+    template<typename T>
+    inline bool get(const uint8_t *&p, const uint8_t *end, T &v)
+    {
+        if((size_t)(end - p) < sizeof(T))
+            return false;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+}
+
+TerrainCache::TerrainCache(const std::string &dir, uint32_t seed, uint32_t flags)
+    : m_dir(dir + "/" + std::to_string(seed)), m_seed(seed), m_flags(flags),
+      m_pending(0), m_useCounter(0), m_hits(0), m_misses(0), m_stored(0)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_dir, ec);
+    if(ec)
+        fprintf(stderr, "[cache] can't create %s: %s\n", m_dir.c_str(), ec.message().c_str());
+}
+
+TerrainCache::~TerrainCache()
+{
+    flush();
+}
+
+const std::string &TerrainCache::directory() const
+{
+    return m_dir;
+}
+
+TerrainCache::Stats TerrainCache::stats() const
+{
+    return {m_hits.load(), m_misses.load(), m_stored.load()};
+}
+
+uint64_t TerrainCache::regionKey(const glm::ivec2 &rpos)
+{
+    return ((uint64_t)(uint32_t)rpos.x << 32) | (uint32_t)rpos.y;
+}
+
+int TerrainCache::slot(const glm::ivec2 &cpos)
+{
+    return (cpos.y & (TCACHE_REGION-1)) + (cpos.x & (TCACHE_REGION-1))*TCACHE_REGION;
+}
+
+std::string TerrainCache::regionPath(const glm::ivec2 &rpos) const
+{
+    return m_dir + "/r." + std::to_string(rpos.x) + "." + std::to_string(rpos.y) + ".tc";
+}
+
+bool TerrainCache::validate(const MappedFile &f, const glm::ivec2 &rpos) const
+{
+    if(f.size() < sizeof(Header) + sizeof(Index))
+        return false;
+
+    Header h;
+    memcpy(&h, f.data(), sizeof(h));
+    return memcmp(h.magic, cacheMagic, 4) == 0 && h.version == TCACHE_VERSION &&
+           h.seed == m_seed && h.flags == m_flags && h.rx == rpos.x && h.rz == rpos.y &&
+           h.width == Chunk::WIDTH && h.height == Chunk::HEIGHT && h.depth == Chunk::DEPTH &&
+           h.worldHeight == WORLD_HEIGHT;
+}
+
+TerrainCache::Region &TerrainCache::region(const glm::ivec2 &rpos)
+{
+    const uint64_t key = regionKey(rpos);
+    auto it = m_regions.find(key);
+    if(it != m_regions.end())
+    {
+        it->second.lastUse = ++m_useCounter;
+        return it->second;
+    }
+
+    // close the least recently used file that has nothing buffered
+    if(m_regions.size() >= TCACHE_OPEN_REGIONS)
+    {
+        auto lru = m_regions.end();
+        for(auto r = m_regions.begin(); r != m_regions.end(); ++r)
+        {
+            if(r->second.pending.empty() && (lru == m_regions.end() || r->second.lastUse < lru->second.lastUse))
+                lru = r;
+        }
+        if(lru != m_regions.end())
+            m_regions.erase(lru);
+    }
+
+    Region &r = m_regions[key];
+    r.lastUse = ++m_useCounter;
+    std::shared_ptr<MappedFile> f = std::make_shared<MappedFile>();
+    if(f->open(regionPath(rpos)) && validate(*f, rpos))
+        r.file = f;
+    return r;
+}
+
+bool TerrainCache::load(const glm::ivec2 &cpos, int *heightmap, Chunk **chunks)
+{
+    const glm::ivec2 rpos(cpos.x >> TCACHE_REGION_SHIFT, cpos.y >> TCACHE_REGION_SHIFT);
+    const int s = slot(cpos);
+
+    std::shared_ptr<MappedFile> f;
+    std::vector<uint8_t> record;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        Region &r = region(rpos);
+        auto p = r.pending.find(s);
+        if(p != r.pending.end())
+            record = p->second;
+        else
+            f = r.file;
+    }
+
+    // decoded outside the lock, the mapping stays valid while we hold it
+    bool ok = false;
+    if(!record.empty())
+    {
+        ok = decode(record.data(), record.size(), cpos, heightmap, chunks);
+    }
+    else if(f != nullptr)
+    {
+        Index idx;
+        memcpy(&idx, f->data() + sizeof(Header), sizeof(idx));
+        const uint64_t end = (uint64_t)idx.offset[s] + idx.length[s];
+        if(idx.length[s] > 0 && end <= f->size())
+            ok = decode(f->data() + idx.offset[s], idx.length[s], cpos, heightmap, chunks);
+    }
+
+    if(ok)
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+    else
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
+
+void TerrainCache::store(const glm::ivec2 &cpos, const int *heightmap, Chunk *const *chunks)
+{
+    std::vector<uint8_t> record;
+    encode(heightmap, chunks, record);
+
+    bool full;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        Region &r = region(glm::ivec2(cpos.x >> TCACHE_REGION_SHIFT, cpos.y >> TCACHE_REGION_SHIFT));
+        if(r.pending.emplace(slot(cpos), std::move(record)).second)
+            m_pending++;
+        full = m_pending >= TCACHE_FLUSH_COLUMNS;
+    }
+    m_stored.fetch_add(1, std::memory_order_relaxed);
+
+    if(full)
+        flush();
+}
+
+void TerrainCache::flush()
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    for(auto &p : m_regions)
+    {
+        Region &r = p.second;
+        if(r.pending.empty())
+            continue;
+
+        const glm::ivec2 rpos((int32_t)(p.first >> 32), (int32_t)(uint32_t)p.first);
+        if(writeRegion(rpos, r))
+        {
+            m_pending -= r.pending.size();
+            r.pending.clear();
+        }
+    }
+}
+
+bool TerrainCache::writeRegion(const glm::ivec2 &rpos, Region &r)
+{
+    Header h;
+    memcpy(h.magic, cacheMagic, 4);
+    h.version = TCACHE_VERSION;
+    h.seed = m_seed;
+    h.flags = m_flags;
+    h.rx = rpos.x;
+    h.rz = rpos.y;
+    h.width = Chunk::WIDTH;
+    h.height = Chunk::HEIGHT;
+    h.depth = Chunk::DEPTH;
+    h.worldHeight = WORLD_HEIGHT;
+
+    // existing records are carried over, buffered ones replace them
+    Index oldIdx, idx;
+    memset(&idx, 0, sizeof(idx));
+    if(r.file != nullptr)
+        memcpy(&oldIdx, r.file->data() + sizeof(Header), sizeof(oldIdx));
+
+    std::vector<uint8_t> body;
+    for(int s=0; s < TCACHE_REGION*TCACHE_REGION; s++)
+    {
+        const uint8_t *src = nullptr;
+        size_t len = 0;
+        auto p = r.pending.find(s);
+        if(p != r.pending.end())
+        {
+            src = p->second.data();
+            len = p->second.size();
+        }
+        else if(r.file != nullptr && oldIdx.length[s] > 0 &&
+                (uint64_t)oldIdx.offset[s] + oldIdx.length[s] <= r.file->size())
+        {
+            src = r.file->data() + oldIdx.offset[s];
+            len = oldIdx.length[s];
+        }
+        if(len == 0)
+            continue;
+
+        idx.offset[s] = sizeof(Header) + sizeof(Index) + body.size();
+        idx.length[s] = len;
+        body.insert(body.end(), src, src + len);
+    }
+
+    const std::string path = regionPath(rpos);
+    const std::string tmp = path + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if(out == nullptr)
+    {
+        fprintf(stderr, "[cache] can't write %s\n", tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+              fwrite(&idx, sizeof(idx), 1, out) == 1 &&
+              fwrite(body.data(), 1, body.size(), out) == body.size();
+    ok = (fclose(out) == 0) && ok;
+
+    // readers still holding the old mapping keep it alive
+    r.file.reset();
+    std::error_code ec;
+    if(ok)
+        std::filesystem::rename(tmp, path, ec);
+    if(!ok || ec)
+    {
+        fprintf(stderr, "[cache] can't replace %s\n", path.c_str());
+        std::filesystem::remove(tmp, ec);
+    }
+
+    std::shared_ptr<MappedFile> f = std::make_shared<MappedFile>();
+    if(f->open(path) && validate(*f, rpos))
+        r.file = f;
+    return ok && r.file != nullptr;
+}
+
+// record: heights as bytes, then per chunk a uniform id or (id, run) pairs
+void TerrainCache::encode(const int *heightmap, Chunk *const *chunks, std::vector<uint8_t> &out)
+{
+    out.clear();
+    for(int i=0; i < Chunk::WIDTH*Chunk::DEPTH; i++)
+        put<uint8_t>(out, heightmap[i]);
+
+    for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+    {
+        const Chunk *ch = chunks[y];
+        if(ch->isUniform())
+        {
+            put<uint8_t>(out, 0);
+            put<uint16_t>(out, ch->uniformBlock());
+            continue;
+        }
+
+        put<uint8_t>(out, 1);
+        const size_t countAt = out.size();
+        put<uint32_t>(out, 0);
+
+        uint32_t runs = 0;
+        int i = 0;
+        while(i < Chunk::VOLUME)
+        {
+            const int id = ch->getBlockAt(i);
+            int len = 1;
+            while(i + len < Chunk::VOLUME && len < 0xffff && ch->getBlockAt(i + len) == id)
+                len++;
+            put<uint16_t>(out, id);
+            put<uint16_t>(out, len);
+            runs++;
+            i += len;
+        }
+        memcpy(out.data() + countAt, &runs, sizeof(runs));
+    }
+}
+
+bool TerrainCache::decode(const uint8_t *data, size_t size, const glm::ivec2 &cpos, int *heightmap, Chunk **chunks)
+{
+    const uint8_t *p = data, *end = data + size;
+    for(int i=0; i < Chunk::WIDTH*Chunk::DEPTH; i++)
+    {
+        uint8_t hgt;
+        if(!get(p, end, hgt))
+            return false;
+        heightmap[i] = hgt;
+    }
+
+    uint16_t blocks[Chunk::VOLUME];
+    int y = 0;
+    for(; y < Chunk::COLUMN_HEIGHT; y++)
+    {
+        uint8_t kind;
+        if(!get(p, end, kind))
+            break;
+
+        bool ok = true;
+        if(kind == 0)
+        {
+            uint16_t id = 0;
+            ok = get(p, end, id);
+            std::fill(blocks, blocks + Chunk::VOLUME, id);
+        }
+        else
+        {
+            uint32_t runs;
+            ok = get(p, end, runs);
+            int i = 0;
+            for(uint32_t r=0; ok && r < runs; r++)
+            {
+                uint16_t id, len;
+                ok = get(p, end, id) && get(p, end, len) && i + len <= Chunk::VOLUME;
+                if(ok)
+                {
+                    std::fill(blocks + i, blocks + i + len, id);
+                    i += len;
+                }
+            }
+            ok = ok && i == Chunk::VOLUME;
+        }
+        if(!ok)
+            break;
+        chunks[y] = Chunk::fromBlocks(glm::ivec3(cpos.x, y, cpos.y), blocks);
+    }
+
+    if(y == Chunk::COLUMN_HEIGHT)
+        return true;
+
+    fprintf(stderr, "[cache] corrupt record for column %d %d\n", cpos.x, cpos.y);
+    while(y-- > 0)
+    {
+        ChunkPool::instance().release(chunks[y]);
+        chunks[y] = nullptr;
+    }
+    return false;
+}
@@ -0,0 +1,93 @@
+#ifndef TERRAINCACHE_HPP
+#define TERRAINCACHE_HPP
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.hpp"
+#include "mappedfile.hpp"
+
+#define TCACHE_DIR "cache"
+#define TCACHE_VERSION (1)
+#define TCACHE_REGION_SHIFT (5)       // region files hold 32x32 columns
+#define TCACHE_REGION (1 << TCACHE_REGION_SHIFT)
+#define TCACHE_OPEN_REGIONS (64)      // mapped region files kept open
+#define TCACHE_FLUSH_COLUMNS (1024)   // columns buffered before they are written out
+
+// On-disk cache of freshly generated columns, one directory per seed.
+// Region files are written whole (temp file + rename) and read through a
+// MappedFile, so a hit costs a run-length decode instead of the noise,
+// surface and carve stages. Files from another format, chunk size or
+// generator flags are treated as misses and replaced on the next flush.
+class TerrainCache
+{
+public:
+    struct Stats
+    {
+        size_t hits, misses, stored;
+    };
+
+    // flags identify generator options that change the output
+    TerrainCache(const std::string &dir, uint32_t seed, uint32_t flags);
+    ~TerrainCache();
+
+    // heightmap gets WIDTH x DEPTH heights, chunks COLUMN_HEIGHT chunks from the pool; false on a miss
+    bool load(const glm::ivec2 &cpos, int *heightmap, Chunk **chunks);
+    void store(const glm::ivec2 &cpos, const int *heightmap, Chunk *const *chunks);
+
+    // writes buffered columns to their region files
+    void flush();
+
+    Stats stats() const;
+    const std::string &directory() const;
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t seed, flags;
+        int32_t rx, rz;
+        uint16_t width, height, depth, worldHeight;
+    };
+
+    // column record offsets/lengths into the file, 0 length for a missing column
+    struct Index
+    {
+        uint32_t offset[TCACHE_REGION * TCACHE_REGION];
+        uint32_t length[TCACHE_REGION * TCACHE_REGION];
+    };
+
+    struct Region
+    {
+        std::shared_ptr<MappedFile> file; // nullptr if there's no usable file
+        std::unordered_map<int, std::vector<uint8_t>> pending; // column slot -> record
+        uint64_t lastUse;
+    };
+
+    Region &region(const glm::ivec2 &rpos); // expects m_lock held
+    bool validate(const MappedFile &f, const glm::ivec2 &rpos) const;
+    bool writeRegion(const glm::ivec2 &rpos, Region &r);
+    std::string regionPath(const glm::ivec2 &rpos) const;
+
+    static void encode(const int *heightmap, Chunk *const *chunks, std::vector<uint8_t> &out);
+    static bool decode(const uint8_t *data, size_t size, const glm::ivec2 &cpos, int *heightmap, Chunk **chunks);
+    static int slot(const glm::ivec2 &cpos);
+    static uint64_t regionKey(const glm::ivec2 &rpos);
+
+    std::string m_dir;
+    uint32_t m_seed, m_flags;
+
+    mutable std::mutex m_lock;
+    std::unordered_map<uint64_t, Region> m_regions;
+    size_t m_pending;
+    uint64_t m_useCounter;
+
+    std::atomic<size_t> m_hits, m_misses, m_stored;
+};
+
+#endif // TERRAINCACHE_HPP
@@ -0,0 +1,145 @@
+#include "world.hpp"
+
+#include <algorithm>
+
+World::World(ChunkStore &store)
+    : m_store(store), m_lastPos(0), m_last(nullptr)
+{
+
+}
+
+Chunk *World::lookup(const glm::ivec3 &cpos)
+{
+    if(m_last != nullptr && cpos == m_lastPos)
+        return m_last;
+
+    Chunk *ch = m_store.get(cpos);
+    if(ch != nullptr) // misses aren't cached, the chunk may show up later
+    {
+        m_last = ch;
+        m_lastPos = cpos;
+    }
+    return ch;
+}
+
+Chunk *World::getChunk(const glm::ivec3 &wpos)
+{
+    return lookup(Chunk::toChunkPos(wpos));
+}
+
+int World::getBlock(const glm::ivec3 &wpos)
+{
+    Chunk *ch = lookup(Chunk::toChunkPos(wpos));
+    if(ch == nullptr)
+        return 0;
+
+    const glm::ivec3 r = Chunk::toLocalPos(wpos);
+    return ch->getBlockAt(Chunk::index(r.x, r.y, r.z));
+}
+
+Chunk *World::detach(const glm::ivec3 &cpos, Chunk *ch)
+{
+    // another World may have swapped in a copy since we cached this one
+    if(ch->snapshotState() == Chunk::SNAPSHOT_DETACHED)
+    {
+        ch = m_store.get(cpos);
+        m_last = ch;
+        m_lastPos = cpos;
+        if(ch == nullptr)
+            return nullptr;
+    }
+
+    // the saver keeps writing the original and retires it afterwards
+    if(!ch->detach())
+        return ch;
+
+    Chunk *copy = Chunk::clone(ch);
+    m_store.set(cpos, copy);
+    m_last = copy;
+    return copy;
+}
+
+bool World::setBlock(const glm::ivec3 &wpos, int id)
+{
+    const glm::ivec3 cpos = Chunk::toChunkPos(wpos);
+    Chunk *ch = lookup(cpos);
+    if(ch == nullptr)
+        return false;
+
+    const glm::ivec3 r = Chunk::toLocalPos(wpos);
+    const int idx = Chunk::index(r.x, r.y, r.z);
+    if(ch->snapshotState() != Chunk::SNAPSHOT_NONE && ch->getBlockAt(idx) != id)
+    {
+        ch = detach(cpos, ch);
+        if(ch == nullptr)
+            return false;
+    }
+    ch->setBlockAt(idx, id);
+    return true;
+}
+
+void World::getBlocks(std::span<const glm::ivec3> wpos, int *out)
+{
+    for(size_t i=0; i < wpos.size(); i++)
+        out[i] = getBlock(wpos[i]);
+}
+
+void World::getBox(const glm::ivec3 &min, const glm::ivec3 &max, int *out)
+{
+    const glm::ivec3 size = max - min;
+    if(size.x <= 0 || size.y <= 0 || size.z <= 0)
+        return;
+
+    // one lookup per overlapped chunk, then copy its part of the box
+    const glm::ivec3 cmin = Chunk::toChunkPos(min);
+    const glm::ivec3 cmax = Chunk::toChunkPos(max - 1);
+    for(int cx = cmin.x; cx <= cmax.x; cx++)
+    {
+        for(int cy = cmin.y; cy <= cmax.y; cy++)
+        {
+            for(int cz = cmin.z; cz <= cmax.z; cz++)
+            {
+                const glm::ivec3 cpos(cx, cy, cz);
+                const glm::ivec3 base = cpos * Chunk::size();
+                const glm::ivec3 lo = glm::max(min, base);
+                const glm::ivec3 hi = glm::min(max, base + Chunk::size());
+                Chunk *ch = lookup(cpos);
+
+                for(int x = lo.x; x < hi.x; x++)
+                {
+                    for(int y = lo.y; y < hi.y; y++)
+                    {
+                        int *row = out + ((x - min.x)*size.y + (y - min.y))*size.z - min.z;
+                        if(ch == nullptr)
+                        {
+                            std::fill(row + lo.z, row + hi.z, 0);
+                            continue;
+                        }
+                        const int idx = Chunk::index(x - base.x, y - base.y, 0) - base.z;
+                        for(int z = lo.z; z < hi.z; z++)
+                            row[z] = ch->getBlockAt(idx + z);
+                    }
+                }
+            }
+        }
+    }
+}
+
+uint64_t World::hash(const glm::ivec2 &minColumn, const glm::ivec2 &maxColumn)
+{
+    uint64_t h = 1469598103934665603ull;
+    for(int x = minColumn.x; x <= maxColumn.x; x++)
+    {
+        for(int z = minColumn.y; z <= maxColumn.y; z++)
+        {
+            for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+            {
+                const Chunk *ch = lookup(glm::ivec3(x, y, z));
+                const uint64_t v = (ch != nullptr) ? ch->contentHash() : 0;
+                for(int b=0; b < 64; b += 8)
+                    h = (h ^ ((v >> b) & 0xff)) * 1099511628211ull;
+            }
+        }
+    }
+    return h;
+}
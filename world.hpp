@@ -0,0 +1,44 @@
+#ifndef WORLD_HPP
+#define WORLD_HPP
+
+#include <glm/glm.hpp>
+#include <span>
+
+#include "chunkstore.hpp"
+
+// Block access in world coordinates on top of a ChunkStore.
+// Remembers the last chunk it resolved, so neighboring queries skip the
+// store lookup. Construct one per frame/task inside an EpochGuard and
+// don't keep it past the guard.
+class World
+{
+public:
+    World(ChunkStore &store);
+
+    // chunk holding a world block position, nullptr if not loaded
+    Chunk *getChunk(const glm::ivec3 &wpos);
+
+    // unloaded blocks read as air
+    int getBlock(const glm::ivec3 &wpos);
+    // false if the chunk isn't loaded; a chunk held by a snapshot is replaced
+    // by a copy first, so one thread at a time
+    bool setBlock(const glm::ivec3 &wpos, int id);
+
+    // out[i] = getBlock(wpos[i])
+    void getBlocks(std::span<const glm::ivec3> wpos, int *out);
+    // box [min, max), out is (max-min) sized and laid out like Chunk::index
+    void getBox(const glm::ivec3 &min, const glm::ivec3 &max, int *out);
+
+    // combined Chunk::contentHash of the columns in [minColumn, maxColumn],
+    // x, then z, then chunks bottom up; unloaded chunks count as 0
+    uint64_t hash(const glm::ivec2 &minColumn, const glm::ivec2 &maxColumn);
+private:
+    Chunk *lookup(const glm::ivec3 &cpos);
+    Chunk *detach(const glm::ivec3 &cpos, Chunk *ch);
+
+    ChunkStore &m_store;
+    glm::ivec3 m_lastPos;
+    Chunk *m_last;
+};
+
+#endif // WORLD_HPP
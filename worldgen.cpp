@@ -0,0 +1,482 @@
+#include "worldgen.hpp"
+#include "chunkpool.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // sorted by x, then z; publish() orders queued writes the same way
+    const glm::ivec2 neighborOffsets[8] =
+    {
+        {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}
+    };
+
+    // splitmix64 finalizer
+    inline uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    inline glm::ivec2 columnOf(const glm::ivec3 &wpos)
+    {
+        return glm::ivec2(wpos.x >> Chunk::SHIFT_X, wpos.z >> Chunk::SHIFT_Z);
+    }
+}
+
+WorldGenerator::Column::Column(const glm::ivec2 &p, bool r, uint32_t gen)
+    : pos(p), regen(r), generation(gen), cached(false), stage(STAGE_NONE), heightmap{}, biomes{}, chunks{}, pending(nullptr)
+{
+
+}
+
+WorldGenerator::Column::~Column()
+{
+    PendingWrite *w = pending.load(std::memory_order_acquire);
+    while(w != nullptr)
+    {
+        PendingWrite *next = w->next;
+        delete w;
+        w = next;
+    }
+    for(Chunk *ch : chunks) // never published
+    {
+        if(ch != nullptr)
+            ChunkPool::instance().release(ch);
+    }
+}
+
+WorldGenerator::WorldGenerator(ChunkStore &store, JobSystem &jobs, uint32_t seed)
+    : m_store(store), m_jobs(jobs), m_seed(seed), m_terrain(TerrainSampler::shared(seed)),
+      m_biomes(BiomeMap::shared(seed)), m_caveNoise(seed ^ 0x5bd1e995u), m_caves(true), m_storage(nullptr),
+      m_resetting(false), m_generation(0)
+{
+
+}
+
+WorldGenerator::~WorldGenerator()
+{
+    reset(m_seed);
+}
+
+uint32_t WorldGenerator::seed() const
+{
+    return m_seed;
+}
+
+void WorldGenerator::setCaves(bool enabled)
+{
+    m_caves = enabled;
+    openCache();
+}
+
+void WorldGenerator::setCacheDir(const std::string &dir)
+{
+    m_cacheDir = dir;
+    openCache();
+}
+
+void WorldGenerator::openCache()
+{
+    m_cache.reset(); // flushes
+    if(!m_cacheDir.empty())
+        m_cache = std::make_unique<TerrainCache>(m_cacheDir, m_seed, m_caves ? 1 : 0);
+}
+
+void WorldGenerator::flushCache()
+{
+    if(m_cache != nullptr)
+        m_cache->flush();
+}
+
+void WorldGenerator::setStorage(RegionStorage *storage)
+{
+    m_storage = storage;
+}
+
+TerrainCache::Stats WorldGenerator::cacheStats() const
+{
+    return (m_cache != nullptr) ? m_cache->stats() : TerrainCache::Stats{0, 0, 0};
+}
+
+size_t WorldGenerator::pendingColumns() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_columns.size();
+}
+
+uint64_t WorldGenerator::columnKey(const glm::ivec2 &cpos)
+{
+    return ((uint64_t)(uint32_t)cpos.x << 32) | (uint32_t)cpos.y;
+}
+
+WorldGenerator::Stage WorldGenerator::neighborPrereq(int stage)
+{
+    switch(stage)
+    {
+    case STAGE_DECORATE: // neighbors must exist to take cross-border writes
+        return STAGE_NOISE;
+    case STAGE_PUBLISH:  // every write into this column has been queued
+        return STAGE_DECORATE;
+    default:
+        return STAGE_NONE;
+    }
+}
+
+WorldGenerator::ColumnPtr WorldGenerator::find(const glm::ivec2 &cpos) const
+{
+    auto it = m_columns.find(columnKey(cpos));
+    return (it != m_columns.end()) ? it->second : nullptr;
+}
+
+JobSystem::Handle WorldGenerator::request(const glm::ivec2 &cpos, JobSystem::Priority prio)
+{
+    std::unique_lock<std::mutex> lk(m_lock);
+    // a column asked for during a reset comes from the new seed
+    m_resetCv.wait(lk, [this] { return !m_resetting; });
+    if(find(cpos) == nullptr)
+    {
+        const uint64_t key = columnKey(cpos);
+        const bool regen = m_published.erase(key) > 0;
+        m_columns[key] = std::make_shared<Column>(cpos, regen, m_generation.load());
+    }
+    return ensure(cpos, STAGE_PUBLISH, prio);
+}
+
+JobSystem::Handle WorldGenerator::ensure(const glm::ivec2 &cpos, int stage, JobSystem::Priority prio)
+{
+    if(stage <= STAGE_NONE)
+        return JobSystem::Handle();
+
+    ColumnPtr col = find(cpos);
+    if(col == nullptr)
+    {
+        const uint64_t key = columnKey(cpos);
+        if(m_published.count(key)) // every stage is done
+            return JobSystem::Handle();
+        col = std::make_shared<Column>(cpos, false, m_generation.load());
+        m_columns[key] = col;
+    }
+    if(col->jobs[stage].valid())
+        return col->jobs[stage];
+
+    std::vector<JobSystem::Handle> deps;
+    std::vector<ColumnPtr> neighbors;
+    deps.push_back(ensure(cpos, stage - 1, prio));
+
+    const Stage pre = neighborPrereq(stage);
+    if(pre != STAGE_NONE && !col->regen)
+    {
+        for(const glm::ivec2 &d : neighborOffsets)
+        {
+            deps.push_back(ensure(cpos + d, pre, prio));
+            if(stage == STAGE_DECORATE)
+                neighbors.push_back(find(cpos + d));
+        }
+    }
+
+    col->jobs[stage] = m_jobs.submit([this, col, stage, neighbors]
+    {
+        runStage(*col, stage, neighbors);
+    }, prio, deps);
+    return col->jobs[stage];
+}
+
+void WorldGenerator::runStage(Column &col, int stage, const std::vector<ColumnPtr> &neighbors)
+{
+    // reset since it was scheduled, its seed and cache are on the way out;
+    // the chunks it made go back to the pool with the column
+    if(col.generation != m_generation.load(std::memory_order_acquire))
+    {
+        col.stage.store(stage, std::memory_order_release);
+        return;
+    }
+
+    switch(stage)
+    {
+    case STAGE_NOISE:
+        noise(col);
+        break;
+    case STAGE_SURFACE:
+        if(!col.cached)
+            surface(col);
+        break;
+    case STAGE_CARVE:
+        if(!col.cached)
+            carve(col);
+        break;
+    case STAGE_DECORATE:
+        decorate(col, neighbors);
+        break;
+    case STAGE_PUBLISH:
+        publish(col);
+        break;
+    }
+    col.stage.store(stage, std::memory_order_release);
+}
+
+void WorldGenerator::noise(Column &col)
+{
+    if(m_cache != nullptr && m_cache->load(col.pos, col.heightmap, col.chunks))
+    {
+        col.cached = true;
+        return;
+    }
+    m_terrain->heightmap(col.pos, Chunk::WIDTH, Chunk::DEPTH, col.heightmap);
+    m_biomes->biomes(col.pos, Chunk::WIDTH, Chunk::DEPTH, col.biomes);
+}
+
+void WorldGenerator::surface(Column &col)
+{
+    for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+        col.chunks[y] = Chunk::createChunk(glm::ivec3(col.pos.x, y, col.pos.y), col.heightmap, col.biomes);
+}
+
+void WorldGenerator::carve(Column &col)
+{
+    if(!m_caves)
+        return;
+
+    // only solid blocks between the floor and the column's highest surface can be carved
+    const int *hm = col.heightmap;
+    const int top = *std::max_element(hm, hm + Chunk::WIDTH*Chunk::DEPTH);
+    const int bottom = std::max(CAVE_FLOOR, 2);
+    if(top <= bottom)
+        return;
+
+    // density lattice on world multiples of CAVE_GRID, so neighbors agree at the border
+    static_assert((CAVE_GRID & (CAVE_GRID-1)) == 0, "cave grid must be a power of two");
+    const glm::ivec3 base(col.pos.x*Chunk::WIDTH, bottom, col.pos.y*Chunk::DEPTH);
+    const glm::ivec3 g0 = glm::ivec3(base.x & ~(CAVE_GRID-1), bottom & ~(CAVE_GRID-1), base.z & ~(CAVE_GRID-1));
+    const glm::ivec3 n = (glm::ivec3(base.x + Chunk::WIDTH - 1, top - 1, base.z + Chunk::DEPTH - 1) - g0) / CAVE_GRID + 2;
+    const size_t count = n.x*n.y*n.z;
+
+    std::vector<double> xs(count), ys(count), zs(count), density(count), detail(count);
+    for(int i=0; i < n.x; i++)
+    {
+        for(int j=0; j < n.y; j++)
+        {
+            for(int k=0; k < n.z; k++)
+            {
+                const size_t idx = (i*n.y + j)*n.z + k;
+                xs[idx] = (g0.x + i*CAVE_GRID) / CAVE_SCALE;
+                ys[idx] = (g0.y + j*CAVE_GRID) / CAVE_SCALE;
+                zs[idx] = (g0.z + k*CAVE_GRID) / CAVE_SCALE;
+            }
+        }
+    }
+    m_caveNoise.noise3D(xs.data(), ys.data(), zs.data(), density.data(), count);
+    for(size_t i=0; i < count; i++)
+    {
+        xs[i] *= 2;
+        ys[i] *= 2;
+        zs[i] *= 2;
+    }
+    m_caveNoise.noise3D(xs.data(), ys.data(), zs.data(), detail.data(), count);
+    for(size_t i=0; i < count; i++)
+        density[i] += 0.5 * detail[i];
+
+    auto at = [&](int i, int j, int k) { return density[(i*n.y + j)*n.z + k]; };
+    const double inv = 1.0 / CAVE_GRID;
+
+    for(int cy = bottom >> Chunk::SHIFT_Y; cy <= (top - 1) >> Chunk::SHIFT_Y; cy++)
+    {
+        Chunk *ch = col.chunks[cy];
+        if(ch->isUniform() && ch->uniformBlock() == 0)
+            continue;
+
+        for(int x=0; x < Chunk::WIDTH; x++)
+        {
+            for(int z=0; z < Chunk::DEPTH; z++)
+            {
+                const int surface = hm[z + x*Chunk::DEPTH];
+                const int y0 = std::max(bottom, cy*Chunk::HEIGHT);
+                const int y1 = std::min(surface, (cy+1)*Chunk::HEIGHT);
+                for(int y = y0; y < y1; y++)
+                {
+                    const glm::ivec3 rel = glm::ivec3(base.x + x, y, base.z + z) - g0;
+                    const glm::ivec3 c = rel / CAVE_GRID;
+                    const double fx = (rel.x % CAVE_GRID) * inv;
+                    const double fy = (rel.y % CAVE_GRID) * inv;
+                    const double fz = (rel.z % CAVE_GRID) * inv;
+
+                    const double d00 = at(c.x, c.y, c.z)     + fz*(at(c.x, c.y, c.z+1)     - at(c.x, c.y, c.z));
+                    const double d01 = at(c.x, c.y+1, c.z)   + fz*(at(c.x, c.y+1, c.z+1)   - at(c.x, c.y+1, c.z));
+                    const double d10 = at(c.x+1, c.y, c.z)   + fz*(at(c.x+1, c.y, c.z+1)   - at(c.x+1, c.y, c.z));
+                    const double d11 = at(c.x+1, c.y+1, c.z) + fz*(at(c.x+1, c.y+1, c.z+1) - at(c.x+1, c.y+1, c.z));
+                    const double d0 = d00 + fy*(d01 - d00);
+                    const double d1 = d10 + fy*(d11 - d10);
+                    if(d0 + fx*(d1 - d0) > CAVE_THRESHOLD)
+                        ch->setBlockAt(Chunk::index(x, y - cy*Chunk::HEIGHT, z), 0);
+                }
+            }
+        }
+    }
+}
+
+template<typename Emit>
+void WorldGenerator::placeFeatures(const glm::ivec2 &cpos, const int *heightmap, Emit emit) const
+{
+    const uint64_t h = mix(((uint64_t)m_seed << 32) ^ mix(columnKey(cpos)));
+    if(h % WORLDGEN_BOULDER_CHANCE != 0)
+        return;
+
+    // boulder resting on the surface, may reach one column over
+    const int lx = (h >> 8) % Chunk::WIDTH;
+    const int lz = (h >> 16) % Chunk::DEPTH;
+    const int r = std::min(1 + (int)((h >> 24) & 1), std::min(Chunk::WIDTH, Chunk::DEPTH));
+    const glm::ivec3 center(cpos.x*Chunk::WIDTH + lx, heightmap[lz + lx*Chunk::DEPTH], cpos.y*Chunk::DEPTH + lz);
+
+    for(int dx = -r; dx <= r; dx++)
+    {
+        for(int dy = -r; dy <= r; dy++)
+        {
+            for(int dz = -r; dz <= r; dz++)
+            {
+                if(dx*dx + dy*dy + dz*dz > r*r)
+                    continue;
+                const glm::ivec3 p = center + glm::ivec3(dx, dy, dz);
+                if(p.y < 2 || p.y >= WORLD_HEIGHT) // keep the bedrock
+                    continue;
+                emit(p, 4); // cobblestone
+            }
+        }
+    }
+}
+
+void WorldGenerator::applyWrite(Column &col, const glm::ivec3 &wpos, int id)
+{
+    const int cy = wpos.y >> Chunk::SHIFT_Y;
+    if(cy < 0 || cy >= Chunk::COLUMN_HEIGHT)
+        return;
+
+    const glm::ivec3 r = Chunk::toLocalPos(wpos);
+    col.chunks[cy]->setBlockAt(Chunk::index(r.x, r.y, r.z), id);
+}
+
+void WorldGenerator::decorate(Column &col, const std::vector<ColumnPtr> &neighbors)
+{
+    int seq = 0;
+    placeFeatures(col.pos, col.heightmap, [&](const glm::ivec3 &wpos, int id)
+    {
+        seq++;
+        const glm::ivec2 owner = columnOf(wpos);
+        if(owner == col.pos)
+        {
+            if(!col.cached)
+                applyWrite(col, wpos, id);
+            return;
+        }
+        for(const ColumnPtr &n : neighbors)
+        {
+            // regenerated neighbors replay this column's features themselves
+            if(n == nullptr || n->pos != owner || n->regen)
+                continue;
+            PendingWrite *w = new PendingWrite{wpos, id, col.pos, seq, n->pending.load(std::memory_order_relaxed)};
+            while(!n->pending.compare_exchange_weak(w->next, w, std::memory_order_release, std::memory_order_relaxed));
+            return;
+        }
+    });
+
+    if(!col.regen || col.cached)
+        return;
+
+    // the neighbors were published long ago, replay the parts of their features that reach in here
+    int hmap[Chunk::WIDTH * Chunk::DEPTH];
+    for(const glm::ivec2 &d : neighborOffsets)
+    {
+        const glm::ivec2 npos = col.pos + d;
+        m_terrain->heightmap(npos, Chunk::WIDTH, Chunk::DEPTH, hmap);
+        placeFeatures(npos, hmap, [&](const glm::ivec3 &wpos, int id)
+        {
+            if(columnOf(wpos) == col.pos)
+                applyWrite(col, wpos, id);
+        });
+    }
+}
+
+void WorldGenerator::publish(Column &col)
+{
+    // queue order depends on scheduling, apply in the order a regenerated
+    // column replays its neighbors: by source column, then emission order
+    std::vector<PendingWrite*> writes;
+    for(PendingWrite *w = col.pending.exchange(nullptr, std::memory_order_acquire); w != nullptr; w = w->next)
+        writes.push_back(w);
+    std::sort(writes.begin(), writes.end(), [](const PendingWrite *a, const PendingWrite *b)
+    {
+        if(a->source.x != b->source.x)
+            return a->source.x < b->source.x;
+        if(a->source.y != b->source.y)
+            return a->source.y < b->source.y;
+        return a->seq < b->seq;
+    });
+    for(PendingWrite *w : writes)
+    {
+        if(!col.cached) // a cached column already holds every write its neighbors make
+            applyWrite(col, w->pos, w->id);
+        delete w;
+    }
+    if(m_cache != nullptr && !col.cached)
+        m_cache->store(col.pos, col.heightmap, col.chunks);
+
+    RegionStorage *storage = m_storage.load();
+    for(int y=0; y < Chunk::COLUMN_HEIGHT; y++)
+    {
+        Chunk *ch = col.chunks[y];
+        col.chunks[y] = nullptr;
+        if(storage != nullptr)
+        {
+            // edits saved earlier win over the generated blocks
+            if(Chunk *saved = storage->load(glm::ivec3(col.pos.x, y, col.pos.y)))
+            {
+                ChunkPool::instance().release(ch);
+                ch = saved;
+            }
+        }
+        ch->markSaved(); // generated blocks aren't edits
+        if(!m_store.insert(glm::ivec3(col.pos.x, y, col.pos.y), ch))
+            ChunkPool::instance().release(ch); // never published
+    }
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    const uint64_t key = columnKey(col.pos);
+    auto it = m_columns.find(key);
+    if(it != m_columns.end() && it->second.get() == &col)
+        m_columns.erase(it);
+    m_published.insert(key);
+}
+
+void WorldGenerator::reset(uint32_t seed)
+{
+    std::vector<JobSystem::Handle> outstanding;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_resetting = true;
+        m_generation++;
+        for(const auto &c : m_columns)
+        {
+            for(const JobSystem::Handle &h : c.second->jobs)
+            {
+                if(h.valid())
+                    outstanding.push_back(h);
+            }
+        }
+    }
+    m_jobs.wait(outstanding);
+
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_columns.clear();
+        m_published.clear();
+        m_seed = seed;
+        m_terrain = TerrainSampler::shared(seed);
+        m_biomes = BiomeMap::shared(seed);
+        m_caveNoise.reseed(seed ^ 0x5bd1e995u);
+        openCache();
+        m_resetting = false;
+    }
+    m_resetCv.notify_all();
+}
@@ -0,0 +1,140 @@
+#ifndef WORLDGEN_HPP
+#define WORLDGEN_HPP
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "chunkstore.hpp"
+#include "jobsystem.hpp"
+#include "biome.hpp"
+#include "terrain.hpp"
+#include "regionfile.hpp"
+#include "terraincache.hpp"
+
+// one cobblestone boulder per this many columns on average
+#define WORLDGEN_BOULDER_CHANCE (24)
+
+// caves: 3D noise density sampled every CAVE_GRID blocks, carved where it exceeds CAVE_THRESHOLD
+#define CAVE_SCALE (24.0)    // blocks per noise unit
+#define CAVE_THRESHOLD (0.35)
+#define CAVE_GRID (4)        // power of two
+#define CAVE_FLOOR (4)       // nothing below this height is carved
+
+// Staged column generation on the job system.
+// Every column goes through noise -> surface -> carve -> decorate -> publish,
+// each stage is a job that depends on the column's previous stage and on the
+// stage its 8 neighbors must have reached first (see neighborPrereq()).
+// Decoration may cross column borders: writes into a neighbor are pushed onto
+// the neighbor's lock-free queue and applied when that neighbor publishes,
+// sorted by source column and emission order so the result never depends on
+// which neighbor ran first.
+// Columns generated a second time (e.g. after eviction) don't wait for their
+// neighbors; their neighbors' features are replayed from the seed instead.
+// With a terrain cache, a cached column is loaded in the noise stage and
+// skips surface and carve, it still feeds its features to its neighbors.
+// Chunks saved in the region storage replace the generated ones on publish.
+class WorldGenerator
+{
+public:
+    enum Stage { STAGE_NONE, STAGE_NOISE, STAGE_SURFACE, STAGE_CARVE, STAGE_DECORATE, STAGE_PUBLISH, STAGE_COUNT };
+
+    WorldGenerator(ChunkStore &store, JobSystem &jobs, uint32_t seed);
+    ~WorldGenerator();
+
+    // schedules whatever the column and its neighbors still need, the handle
+    // finishes once the column's chunks are in the store
+    JobSystem::Handle request(const glm::ivec2 &cpos, JobSystem::Priority prio = JobSystem::NORMAL);
+
+    // waits for outstanding stages, drops unpublished columns and switches seed;
+    // request() blocks meanwhile and stages scheduled before it are skipped
+    void reset(uint32_t seed);
+
+    uint32_t seed() const;
+    // both only while nothing is being generated
+    void setCaves(bool enabled);
+    // directory for the generated-terrain cache, empty disables it
+    void setCacheDir(const std::string &dir);
+
+    void flushCache();
+    TerrainCache::Stats cacheStats() const;
+
+    // saved chunks to publish instead of generated ones, nullptr for none
+    void setStorage(RegionStorage *storage);
+    // columns generated part way, waiting for neighbors or a request
+    size_t pendingColumns() const;
+
+    // stage the 8 neighbors must have completed before a stage runs
+    static Stage neighborPrereq(int stage);
+private:
+    struct PendingWrite
+    {
+        glm::ivec3 pos; // world block position
+        int id;
+        glm::ivec2 source; // column whose feature made the write
+        int seq;           // emission order within the source
+        PendingWrite *next;
+    };
+
+    struct Column
+    {
+        Column(const glm::ivec2 &p, bool r, uint32_t gen);
+        ~Column();
+
+        glm::ivec2 pos;
+        bool regen;
+        uint32_t generation; // reset() count when it was scheduled
+        bool cached; // loaded from the terrain cache, set by the noise stage
+        std::atomic<int> stage; // last completed stage
+        JobSystem::Handle jobs[STAGE_COUNT];
+        int heightmap[Chunk::WIDTH * Chunk::DEPTH];
+        uint8_t biomes[Chunk::WIDTH * Chunk::DEPTH];
+        Chunk *chunks[Chunk::COLUMN_HEIGHT]; // owned until published
+        std::atomic<PendingWrite*> pending;
+    };
+    typedef std::shared_ptr<Column> ColumnPtr;
+
+    // both expect m_lock held
+    JobSystem::Handle ensure(const glm::ivec2 &cpos, int stage, JobSystem::Priority prio);
+    ColumnPtr find(const glm::ivec2 &cpos) const;
+
+    void runStage(Column &col, int stage, const std::vector<ColumnPtr> &neighbors);
+    void noise(Column &col);
+    void surface(Column &col);
+    void carve(Column &col);
+    void decorate(Column &col, const std::vector<ColumnPtr> &neighbors);
+    void publish(Column &col);
+
+    // features rooted in a column, emit(world pos, id) may land in a neighbor
+    template<typename Emit>
+    void placeFeatures(const glm::ivec2 &cpos, const int *heightmap, Emit emit) const;
+    static void applyWrite(Column &col, const glm::ivec3 &wpos, int id);
+
+    static uint64_t columnKey(const glm::ivec2 &cpos);
+    void openCache();
+
+    ChunkStore &m_store;
+    JobSystem &m_jobs;
+    uint32_t m_seed;
+    std::shared_ptr<TerrainSampler> m_terrain;
+    std::shared_ptr<BiomeMap> m_biomes;
+    siv::PerlinNoise m_caveNoise;
+    bool m_caves;
+    std::string m_cacheDir;
+    std::unique_ptr<TerrainCache> m_cache;
+    std::atomic<RegionStorage*> m_storage;
+
+    mutable std::mutex m_lock; // scheduling state only, block data is never written under it
+    std::condition_variable m_resetCv;
+    std::unordered_map<uint64_t, ColumnPtr> m_columns;
+    std::unordered_set<uint64_t> m_published;
+    bool m_resetting;
+    std::atomic<uint32_t> m_generation;
+};
+
+#endif // WORLDGEN_HPP
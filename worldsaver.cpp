@@ -0,0 +1,267 @@
+#include "worldsaver.hpp"
+
+#include "world.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <unordered_set>
+
+WorldSaver::WorldSaver(ChunkStore &store, RegionStorage *storage)
+    : m_store(store), m_storage(storage), m_journal(nullptr), m_segment(0), m_writing(false), m_finished(false), m_stop(false),
+      m_stats{0, 0, 0, 0, false, 0, 0.0, 0.0}
+{
+    m_thread = std::thread(&WorldSaver::run, this);
+}
+
+WorldSaver::~WorldSaver()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void WorldSaver::setStorage(RegionStorage *storage)
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_storage = storage;
+}
+
+void WorldSaver::setJournal(BlockJournal *journal)
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_journal = journal;
+}
+
+bool WorldSaver::busy() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_writing;
+}
+
+WorldSaver::Stats WorldSaver::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    Stats s = m_stats;
+    s.writing = m_writing;
+    return s;
+}
+
+bool WorldSaver::capture()
+{
+    if(busy())
+        return false;
+
+    const auto t = std::chrono::steady_clock::now();
+    BlockJournal *journal;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        journal = m_journal;
+    }
+    // changes journaled from here on aren't in this snapshot
+    const uint32_t segment = journal != nullptr ? journal->rotate() : 0;
+
+    std::vector<Entry> snapshot;
+    {
+        EpochGuard guard;
+        m_store.forEach([&](Chunk *ch)
+        {
+            if(ch->isModified() && ch->hold())
+                snapshot.push_back({ch, ch->getVersion()});
+        });
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    if(snapshot.empty())
+    {
+        // everything journaled is in the region files already
+        if(journal != nullptr)
+            journal->drop(segment);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_snapshot.swap(snapshot);
+        m_segment = segment;
+        m_writing = true;
+        m_stats.captureMs = ms;
+        m_stats.lastChunks = m_snapshot.size();
+    }
+    m_cv.notify_all();
+    return true;
+}
+
+bool WorldSaver::save(const Chunk *ch)
+{
+    RegionStorage *storage;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        storage = m_storage;
+    }
+    // the journal keeps its changes until a snapshot syncs the file
+    const bool ok = storage != nullptr && storage->save(ch);
+    std::lock_guard<std::mutex> lk(m_lock);
+    if(ok)
+        m_stats.chunks++;
+    else
+        m_stats.failed++;
+    return ok;
+}
+
+bool WorldSaver::poll()
+{
+    std::vector<Written> written;
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        written.swap(m_written);
+        finished = m_finished;
+        m_finished = false;
+    }
+
+    EpochGuard guard;
+    for(const Written &w : written)
+    {
+        // the chunk or the clone that replaced it, edits past the snapshot stay dirty
+        Chunk *ch = m_store.get(w.pos);
+        if(ch != nullptr && ch->getVersion() >= w.version)
+            ch->markSaved(w.version);
+    }
+    return finished;
+}
+
+void WorldSaver::flush()
+{
+    {
+        std::unique_lock<std::mutex> lk(m_lock);
+        m_doneCv.wait(lk, [this] { return !m_writing; });
+    }
+    poll();
+}
+
+size_t WorldSaver::recover(WorldGenerator &gen, JobSystem &jobs)
+{
+    if(m_journal == nullptr)
+        return 0;
+
+    const auto t = std::chrono::steady_clock::now();
+    struct Change
+    {
+        glm::ivec3 pos;
+        int id;
+    };
+    std::vector<Change> changes;
+    m_journal->replay([&](const glm::ivec3 &pos, int id) { changes.push_back({pos, id}); });
+    if(changes.empty())
+    {
+        m_journal->replayed();
+        return 0;
+    }
+
+    // the saved world first, then the changes over it in order
+    std::unordered_set<uint64_t> seen;
+    std::vector<JobSystem::Handle> handles;
+    for(const Change &c : changes)
+    {
+        const glm::ivec3 cpos = Chunk::toChunkPos(c.pos);
+        const glm::ivec2 column(cpos.x, cpos.z);
+        if(seen.insert(((uint64_t)(uint32_t)column.x << 32) | (uint32_t)column.y).second)
+            handles.push_back(gen.request(column, JobSystem::HIGH));
+    }
+    jobs.wait(handles);
+
+    size_t applied = 0;
+    {
+        EpochGuard guard;
+        World world(m_store);
+        for(const Change &c : changes)
+            applied += world.setBlock(c.pos, c.id);
+    }
+
+    // folds the replayed segments into the region files
+    m_journal->replayed();
+    flush();
+    capture();
+    flush();
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    fprintf(stderr, "[journal] replayed %zu of %zu changes over %zu columns in %.1f ms\n",
+            applied, changes.size(), seen.size(), ms);
+    return applied;
+}
+
+void WorldSaver::run()
+{
+    for(;;)
+    {
+        std::vector<Entry> snapshot;
+        RegionStorage *storage;
+        BlockJournal *journal;
+        uint32_t segment;
+        {
+            std::unique_lock<std::mutex> lk(m_lock);
+            m_cv.wait(lk, [this] { return m_stop || !m_snapshot.empty(); });
+            if(m_snapshot.empty()) // stopping
+                return;
+            snapshot.swap(m_snapshot);
+            storage = m_storage;
+            journal = m_journal;
+            segment = m_segment;
+        }
+
+        // region by region, then in file order
+        std::sort(snapshot.begin(), snapshot.end(), [](const Entry &a, const Entry &b)
+        {
+            const glm::ivec3 &p = a.ch->getPos(), &q = b.ch->getPos();
+            const glm::ivec2 rp(p.x >> REGIONFILE_SHIFT, p.z >> REGIONFILE_SHIFT);
+            const glm::ivec2 rq(q.x >> REGIONFILE_SHIFT, q.z >> REGIONFILE_SHIFT);
+            if(rp != rq)
+                return rp.x < rq.x || (rp.x == rq.x && rp.y < rq.y);
+            return RegionFile::slot(p) < RegionFile::slot(q);
+        });
+
+        const auto t = std::chrono::steady_clock::now();
+        std::vector<Written> written;
+        written.reserve(snapshot.size());
+        size_t failed = 0, detached = 0;
+        for(const Entry &e : snapshot)
+        {
+            const bool ok = storage != nullptr && storage->save(e.ch);
+            if(ok)
+                written.push_back({e.ch->getPos(), e.version});
+            else
+                failed++;
+
+            if(!e.ch->unhold())
+            {
+                // replaced by an edit, nothing links to it any more
+                ChunkStore::retire(e.ch);
+                detached++;
+            }
+        }
+        // the journal goes only once the chunks are on disk
+        if(storage != nullptr && !storage->sync())
+            failed++;
+        if(journal != nullptr && segment != 0 && failed == 0)
+            journal->drop(segment);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+
+        {
+            std::lock_guard<std::mutex> lk(m_lock);
+            m_written.insert(m_written.end(), written.begin(), written.end());
+            m_stats.snapshots++;
+            m_stats.chunks += written.size();
+            m_stats.failed += failed;
+            m_stats.detached += detached;
+            m_stats.writeMs = ms;
+            m_writing = false;
+            m_finished = true;
+        }
+        m_doneCv.notify_all();
+        if(failed > 0)
+            fprintf(stderr, "[save] %zu of %zu chunks failed to save\n", failed, snapshot.size());
+    }
+}
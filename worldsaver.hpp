@@ -0,0 +1,96 @@
+#ifndef WORLDSAVER_HPP
+#define WORLDSAVER_HPP
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chunkstore.hpp"
+#include "jobsystem.hpp"
+#include "journal.hpp"
+#include "regionfile.hpp"
+#include "worldgen.hpp"
+
+#define SAVE_INTERVAL_TICKS (60 * 30) // autosave period of the game loop
+
+// Writes modified chunks to region files on a background thread.
+// capture() runs on the main thread and only holds every modified chunk,
+// nothing is copied up front. The writer serializes held chunks in place;
+// an edit to a held chunk swaps a clone into the store (World::setBlock) and
+// the writer retires the original once it's written. poll() marks written
+// chunks saved as of their captured version, later edits stay dirty, and a
+// failed write just leaves its chunk modified for the next snapshot.
+// With a journal, capture() rotates it and a snapshot written and synced
+// without failures drops the segments it covers.
+class WorldSaver
+{
+public:
+    struct Stats
+    {
+        size_t snapshots;      // written
+        size_t chunks, failed; // totals
+        size_t detached;       // held chunks replaced by an edit
+        bool writing;
+        size_t lastChunks;     // last snapshot
+        double captureMs, writeMs;
+    };
+
+    WorldSaver(ChunkStore &store, RegionStorage *storage);
+    ~WorldSaver(); // waits for the snapshot in flight
+
+    WorldSaver(const WorldSaver&) = delete;
+    WorldSaver &operator=(const WorldSaver&) = delete;
+
+    // only while nothing is being written
+    void setStorage(RegionStorage *storage);
+    void setJournal(BlockJournal *journal);
+
+    // main thread, with the store empty: generates the columns the journal's
+    // leftover changes touch, applies them and saves; returns how many were applied.
+    // Until it runs, snapshots keep the earlier runs' segments
+    size_t recover(WorldGenerator &gen, JobSystem &jobs);
+
+    // main thread; false if the previous snapshot is still being written
+    bool capture();
+    // main thread; writes one chunk now, for chunks leaving the store; the caller marks it saved
+    bool save(const Chunk *ch);
+    // main thread; marks written chunks saved, true if a snapshot finished
+    bool poll();
+    // blocks until nothing is being written, then polls
+    void flush();
+
+    bool busy() const;
+    Stats stats() const;
+private:
+    struct Entry
+    {
+        Chunk *ch;
+        uint32_t version;
+    };
+    struct Written
+    {
+        glm::ivec3 pos;
+        uint32_t version;
+    };
+
+    void run();
+
+    ChunkStore &m_store;
+    RegionStorage *m_storage;
+    BlockJournal *m_journal;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_cv, m_doneCv;
+    std::vector<Entry> m_snapshot; // handed to the writer
+    uint32_t m_segment;            // last journal segment the snapshot covers, 0 without one
+    std::vector<Written> m_written; // back to the main thread
+    bool m_writing, m_finished, m_stop;
+    Stats m_stats;
+
+    std::thread m_thread;
+};
+
+#endif // WORLDSAVER_HPP